@@ -1,2 +1,2 @@
-gcc -Wall -g -lm -o doit doit.c
+gcc -Wall -g -o doit doit.c -lm
 gdb -x commands.txt ./doit
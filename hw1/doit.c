@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -10,46 +12,269 @@
 #include <sys/resource.h>
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <stdatomic.h>
 
 // the maximum number of background process we can run simultaneously
-#define MAX_NUM_JOBS 30
-// maximum number of characters in a command
+#define MAX_NUM_JOBS 4096
+// maximum number of characters of a command's name kept in the jobs array, commands themselves can be any length
 #define MAX_COMMAND_LEN 128
-// maxiumum number of completed background processes we can have
-#define MAX_NUM_FINISHED_JOBS 30
+// number of slots in the completion ring, a power of two no smaller than MAX_NUM_JOBS so a finishing job never has to
+// wait for room
+#define COMPLETION_RING_SIZE 4096
+// entries of the shared arena that different processes write to are aligned to this so they don't share cache lines
+#define CACHE_LINE_SIZE 64
+// number of commands a batch run (doit -f script) runs at once when -j is not given
+#define DEFAULT_BATCH_JOBS 1
+// the number of slowest commands listed in the report at the end of a batch run
+#define NUM_SLOWEST_REPORTED 5
+// size of the chunks a batch command's output is read in
+#define BATCH_READ_CHUNK 4096
+// how often a batch command that has closed its output but not exited yet is checked on, in milliseconds
+#define BATCH_REAP_MS 1
+
+// the hardware counters collected when perf mode is on, these are indices into the arrays of a PerfCounters
+#define NUM_PERF_COUNTERS 4
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_MISSES 2
+#define PERF_BRANCH_MISSES 3
+
+// how often a running background job's /proc entries are sampled
+#define SAMPLE_INTERVAL_MS 200
+// the number of points kept in a job's resource time series, when it fills up every pair of points is merged and the
+// time between points doubles, so the series always covers the whole run
+#define SERIES_LEN 32
+
+// how much of a captured background job's output is kept in memory, anything past this spills to a file in /tmp
+#define CAPTURE_MEMORY_LIMIT (1 << 20)
+// number of lines the tail builtin shows when it is not given a number
+#define DEFAULT_TAIL_LINES 10
+// the tail builtin only looks at this many bytes from the end of a job's output
+#define TAIL_WINDOW (64 * 1024)
+
+// number of pre-forked helpers kept waiting when zygote mode is on
+#define ZYGOTE_POOL_SIZE 4
+
+// the metrics the bench builtin summarizes, these are indices into the sample arrays of a bench run
+#define NUM_BENCH_METRICS 7
+#define BENCH_WALL 0
+#define BENCH_USER 1
+#define BENCH_SYSTEM 2
+#define BENCH_MINOR_FAULTS 3
+#define BENCH_MAJOR_FAULTS 4
+#define BENCH_VOLUNTARY_CS 5
+#define BENCH_INVOLUNTARY_CS 6
+
+// number of untimed runs the bench builtin does before measuring when -w is not given
+#define DEFAULT_BENCH_WARMUP 1
+
+// the output formats of the bench builtin
+#define BENCH_TEXT 0
+#define BENCH_CSV 1
+#define BENCH_JSON 2
+
+// summary of the samples of one bench metric
+typedef struct BenchSummary
+{
+	double min;
+	double median;
+	double mean;
+	double p95;
+	double stddev;
+} BenchSummary;
+
+// hardware counters attached to a child process through perf_event_open()
+typedef struct PerfCounters
+{
+	// -1 for a counter that could not be opened
+	int fds[NUM_PERF_COUNTERS];
+
+	// the final counts, -1 for a counter that is not available
+	long long values[NUM_PERF_COUNTERS];
 
-// stores information about a background process
+	// true if the kernel had to multiplex the counters and the values are scaled estimates
+	bool scaled;
+} PerfCounters;
+
+// stores information about a background process. each job is one entry of the job table in the shared arena, main fills in
+// job_num and name before forking, the process that waits on the job fills in everything else
 typedef struct Job
 {
-	int pid;
+	// 0 until the job's process has been forked, -1 if it could not be
+	_Atomic int pid;
 
 	int job_num;
 
 	// the name of the command
-	char* name;
+	char name[MAX_COMMAND_LEN + 1];
 
 	// stores information about the resources used
-	struct rusage* usage;
+	struct rusage usage;
+
+	// the wall time it took to execute
+	int time;
+
+	// true if perf mode was on when the job started, perf then holds its hardware counters
+	bool has_perf;
+	PerfCounters perf;
+
+	// the following are filled in by the sampler while the job runs, see wait_and_sample()
+	double cpu_percent;
+	long rss_kb;
+	long peak_rss_kb;
+
+	// in bytes per second, -1 if /proc/<pid>/io could not be read
+	double read_rate;
+	double write_rate;
+
+	// bytes read from and written to storage so far, -1 if /proc/<pid>/io could not be read
+	long long read_bytes;
+	long long write_bytes;
+
+	// rss (in KB) and cpu percent over time, one point every series_interval_ms
+	int series_len;
+	int series_interval_ms;
+	long rss_series[SERIES_LEN];
+	double cpu_series[SERIES_LEN];
+
+	// samples taken since the last point of the series was added
+	int pending_samples;
+	long pending_rss;
+	double pending_cpu;
+
+	// true if the job's stdout and stderr are being captured, see capture_output()
+	bool captured;
+
+	// number of bytes of output in the job's memfd and in its spill file
+	_Atomic long long memory_len;
+	_Atomic long long spill_len;
+
+	// the file output goes to once the memfd holds CAPTURE_MEMORY_LIMIT bytes, empty until then
+	char spill_path[32];
+} __attribute__((aligned(CACHE_LINE_SIZE))) Job;
+
+// one slot of the completion ring, see push_completion() and pop_completion()
+typedef struct CompletionSlot
+{
+	// the position in the ring this slot is ready for: pos when it can be written, pos + 1 once it holds a job
+	_Atomic unsigned long seq;
+
+	// the index in the job table of the finished job
+	int job;
+} CompletionSlot;
+
+// everything the shell shares with the processes waiting on background jobs, in a single mapping
+typedef struct SharedArena
+{
+	// the next position a finishing job writes to, shared by all of the waiting processes
+	_Atomic unsigned long ring_tail __attribute__((aligned(CACHE_LINE_SIZE)));
+
+	// the next position the shell reads from, only the shell touches it
+	unsigned long ring_head __attribute__((aligned(CACHE_LINE_SIZE)));
+
+	CompletionSlot ring[COMPLETION_RING_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+	Job jobs[MAX_NUM_JOBS];
+} SharedArena;
+
+// one reading of a process' /proc entries
+typedef struct ProcSample
+{
+	struct timespec when;
+
+	// user plus system time in milliseconds
+	long long cpu_ms;
+
+	long rss_kb;
+
+	// the high water mark of the rss as tracked by the kernel
+	long peak_rss_kb;
+
+	// -1 if /proc/<pid>/io could not be read
+	long long read_bytes;
+	long long write_bytes;
+} ProcSample;
+
+// stores information about one command of a batch run
+typedef struct BatchJob
+{
+	// the command as it appeared in the script, without the newline
+	char* cmd;
+
+	char** args;
+
+	int pid;
+
+	// read end of the pipe that the command's stdout and stderr are captured through, -1 once it has been closed
+	int fd;
+
+	// everything the command has written so far
+	char* output;
+	size_t output_len;
+	size_t output_cap;
+
+	struct rusage usage;
 
 	// the wall time it took to execute
 	int time;
-} Job;
 
-// all of the following pointers are allocated on shared memory
-Job** jobs;
+	struct timeval start;
+
+	bool finished;
+
+	PerfCounters perf;
+} BatchJob;
+
+// when true, hardware counters are attached to every command and printed with its stats. set with -p or "set perf = on"
+bool perf_enabled = false;
+
+// when true, foreground, batch and bench commands are handed to a pre-forked helper instead of forking. set with -z or
+// "set zygote = on"
+bool zygote_enabled = false;
+
+// the helpers of zygote mode, each is a child of this process blocked reading its socket until it is given a command
+int zygote_pids[ZYGOTE_POOL_SIZE];
+int zygote_socks[ZYGOTE_POOL_SIZE];
+int zygote_pool_len = 0;
+
+// the environment, passed on to the helpers with every command
+extern char** environ;
+
+// when true, the output of background jobs is captured and shown when they complete instead of going straight to the
+// terminal. set with "set capture = on"
+bool capture_enabled = false;
+
+// the job table and completion ring, allocated on shared memory
+SharedArena* arena;
 
-// the number of active jobs in jobs array
-int* num_jobs;
+// the rest of the job bookkeeping is only ever touched by the shell itself, so it lives in ordinary memory
+
+// the number of active jobs
+int num_jobs = 0;
 
 // the number that will correspond to a job. resets back to one when all background tasks finish
-int* job_number;
+int job_number = 1;
+
+// indices of the unused entries of the job table, used as a stack
+int free_jobs[MAX_NUM_JOBS];
+int num_free_jobs = 0;
 
-// note: must terminate with a -1 similar to how a string must terminate with a '\0'
-int* finished_pids;
+// the active jobs as a doubly linked list of job table indices in the order they were started, -1 ends the list
+int first_job = -1;
+int last_job = -1;
+int next_job[MAX_NUM_JOBS];
+int prev_job[MAX_NUM_JOBS];
 
-// whenever you want to modify shared memory, you must wait for this to become false, then set it to true while modifying
-// the memory, then set it back when you are finished
-bool* shared_mem_in_use;
+// the memfd each job's output is captured into, -1 if the job is not captured
+int capture_fds[MAX_NUM_JOBS];
 
 /*
  * executes a bash command
@@ -62,33 +287,53 @@ bool* shared_mem_in_use;
 int execute_command(char** args, bool background);
 
 /*
- * gets a command from the user to run
+ * gets a command from the user to run, lines can be any length
  * params
  * prompt: the string to use as the prompt for the user
  * returns
- * the retrieved string
+ * the retrieved string, which must be freed, or NULL at the end of input
 */
 char* get_input(char* prompt);
 
 /*
- * parses a command to split up its arguments into separate strings
+ * parses a command to split up its arguments into separate strings. arguments are separated by spaces, tabs or newlines.
+ * text in single quotes is taken literally, text in double quotes keeps its spaces and a backslash escapes the next
+ * character (inside double quotes only \\, \", \$ and \` are escapes). the argument array and the strings it points to
+ * are allocated together in a single block, so the whole command is released with one free(args)
  * params
  * cmd: the command to parse
  * returns
- * the parsed command
+ * the parsed command, args[0] is NULL if the command is empty or has an unterminated quote
  * note:
  * an example of a parsed command is the in the execute_command function header comment
 */
 char** get_args(char* cmd);
 
 /*
- * checks for finished processes in the finished_pids array and then removes them from the jobs array if the corresponding process is found
- * also prints the stats about the finished process
+ * takes every finished job off the completion ring, prints its stats and frees its entry in the job table. each job is
+ * handled in constant time
  * params none
  * returns void
 */
 void check_finished_processes(void);
 
+/*
+ * adds a finished job to the completion ring. called by the process that waited on the job, any number of them may call
+ * this at the same time without locking
+ * params
+ * job: the index of the job in the job table
+ * returns void
+*/
+void push_completion(int job);
+
+/*
+ * takes the oldest finished job off the completion ring, only called by the shell
+ * params none
+ * returns
+ * the index of the job in the job table, or -1 if no job has finished
+*/
+int pop_completion(void);
+
 /*
  * prints the stats about a process
  * params
@@ -98,6 +343,260 @@ void check_finished_processes(void);
 */
 void print_stats(struct rusage* usage, int time);
 
+/*
+ * runs every command in a script file, keeping up to max_parallel of them running at once. the output of each command is
+ * captured and printed in the order the commands appear in the script, followed by the command's stats. a report with
+ * the total wall time, the summed cpu time and the slowest commands is printed at the end
+ * params
+ * filename: the script to run, one command per line. blank lines and lines starting with '#' are skipped
+ * max_parallel: the maximum number of commands running at the same time
+ * returns
+ * 1 if every command could be started, 0 otherwise
+*/
+int run_batch(char* filename, int max_parallel);
+
+/*
+ * forks and starts a command of a batch run with its stdout and stderr redirected into a pipe
+ * params
+ * job: the command to start, its pid, fd and start fields are filled in
+ * returns
+ * 1 if successful, 0 otherwise
+*/
+int start_batch_job(BatchJob* job);
+
+/*
+ * reads whatever is available on a batch command's pipe into its output buffer. when the pipe reaches end of file the
+ * pipe is closed and the command is reaped if it has already exited
+ * params
+ * job: the command to read from
+ * returns void
+*/
+void read_batch_output(BatchJob* job);
+
+/*
+ * reaps a batch command that has closed its output, without blocking, and fills in its stats if it has exited
+ * params
+ * job: the command to reap
+ * returns void
+*/
+void reap_batch_job(BatchJob* job);
+
+/*
+ * creates the pipe a child blocks on until its hardware counters are attached, only used when perf mode is on
+ * params
+ * gate: filled in with the two ends of the pipe
+ * returns
+ * 1 if successful, 0 otherwise
+*/
+int open_perf_gate(int gate[2]);
+
+/*
+ * closes both ends of a gate no child was forked for
+ * params
+ * gate: the pipe created by open_perf_gate()
+ * returns void
+*/
+void close_perf_gate(int gate[2]);
+
+/*
+ * called by a freshly forked child before execvp(), blocks until the parent has attached the counters and closed the gate
+ * params
+ * gate: the pipe created by open_perf_gate()
+ * returns void
+*/
+void wait_at_perf_gate(int gate[2]);
+
+/*
+ * attaches the hardware counters to a child blocked at its gate (or a zygote helper, which has no gate) and then lets it
+ * continue. the counters only start
+ * counting once the child calls execvp() and are inherited by any process the command forks. if the counters cannot be
+ * opened (for example because of perf_event_paranoid) a message is printed once and the command runs without them
+ * params
+ * pid: the child to attach to
+ * gate: the pipe the child is blocked on, NULL if there is none
+ * perf: filled in with the counter file descriptors
+ * returns void
+*/
+void attach_perf_counters(int pid, int gate[2], PerfCounters* perf);
+
+/*
+ * reads the final counts from counters attached with attach_perf_counters() and closes them, must be called after the
+ * child has been reaped
+ * params
+ * perf: the counters to read, values and scaled are filled in
+ * returns void
+*/
+void collect_perf_counters(PerfCounters* perf);
+
+/*
+ * prints the hardware counters of a process
+ * params
+ * perf: the counters collected with collect_perf_counters()
+ * returns void
+*/
+void print_perf(PerfCounters* perf);
+
+/*
+ * waits for a background job to finish while sampling its cpu, memory and io usage every SAMPLE_INTERVAL_MS. SIGCHLD is
+ * blocked and waited on with a timeout so the job's exit is noticed immediately rather than at the next sample. if the
+ * job's output is captured, the pipe it writes to is read in the same loop
+ * params
+ * pid: the job's process
+ * job: the job's entry in the jobs array, its sampler fields and usage are filled in
+ * status: filled in with the job's exit status
+ * out_fd: the read end of the pipe the job's output goes to, -1 if it is not captured
+ * memfd: the memfd the output is captured into
+ * returns
+ * the return value of the wait4() that reaped the job
+*/
+int wait_and_sample(int pid, Job* job, int* status, int out_fd, int memfd);
+
+/*
+ * stores output read from a captured job. the first CAPTURE_MEMORY_LIMIT bytes go to the job's memfd, the rest to a
+ * spill file that is created when it is first needed
+ * params
+ * job: the job the output belongs to
+ * memfd: the job's memfd
+ * buf: the output
+ * len: the number of bytes in buf
+ * returns void
+*/
+void capture_output(Job* job, int memfd, char* buf, size_t len);
+
+/*
+ * prints a captured job's output, either all of it or just its last lines
+ * params
+ * slot: the job's index in the job table
+ * lines: the number of lines to print from the end, -1 for all of the output
+ * returns void
+*/
+void print_captured(int slot, int lines);
+
+/*
+ * releases a captured job's memfd and deletes its spill file
+ * params
+ * slot: the job's index in the job table
+ * returns void
+*/
+void release_capture(int slot);
+
+/*
+ * reads a process' /proc/<pid>/stat, status and io files
+ * params
+ * pid: the process to read
+ * sample: filled in with the reading
+ * returns
+ * 1 if successful, 0 if the process could not be read
+*/
+int read_proc_sample(int pid, ProcSample* sample);
+
+/*
+ * updates a job's live stats and time series from two consecutive samples
+ * params
+ * job: the job to update
+ * prev: the previous sample, NULL for the first sample of the job
+ * cur: the new sample
+ * returns void
+*/
+void update_job_sample(Job* job, ProcSample* prev, ProcSample* cur);
+
+/*
+ * prints the sampler's summary for a finished background job
+ * params
+ * job: the finished job
+ * returns void
+*/
+void print_job_samples(Job* job);
+
+/*
+ * the bench builtin: "bench [-w warmup] [-f text|csv|json] [-o file] <runs> <command>". runs the command warmup times
+ * without measuring it, then runs times measuring each run, and prints min/median/mean/p95/stddev of the wall, user and
+ * system time, page faults and context switches. wall time is taken from CLOCK_MONOTONIC in nanoseconds. the command's
+ * stdout is discarded so printing it does not skew the timings
+ * params
+ * args: the parsed command, args[0] is "bench"
+ * returns
+ * 1 if successful, 0 otherwise
+*/
+int run_bench(char** args);
+
+/*
+ * runs a command once for the bench builtin
+ * params
+ * args: the command to run
+ * sample: if not NULL, filled in with one value per bench metric (times in nanoseconds)
+ * returns
+ * 1 if successful, 0 if the command could not be run
+*/
+int bench_once(char** args, double* sample);
+
+/*
+ * summarizes the samples of one metric
+ * params
+ * samples: the samples, they are sorted in place
+ * num_samples: the number of samples
+ * returns
+ * the summary
+*/
+BenchSummary summarize_samples(double* samples, int num_samples);
+
+/*
+ * qsort() comparator for doubles
+ * params
+ * a: pointer to the first double
+ * b: pointer to the second double
+ * returns
+ * negative, zero or positive if a is less than, equal to or greater than b
+*/
+int compare_doubles(const void* a, const void* b);
+
+/*
+ * tops the zygote pool back up to ZYGOTE_POOL_SIZE helpers. this is the only place zygote mode forks, and it is called
+ * right after a command has been handed off so the fork overlaps with the command instead of delaying the next one
+ * params none
+ * returns void
+*/
+void zygote_refill(void);
+
+/*
+ * runs a command on a helper from the zygote pool. the helper is sent the working directory, the arguments and the
+ * environment over its unix socket, along with the file descriptors to use as its stdout and stderr, and then execs the
+ * command. the helper is a child of this process so it is waited on like a forked one
+ * params
+ * args: the command to run
+ * out_fd: the file descriptor the command's stdout is sent to
+ * err_fd: the file descriptor the command's stderr is sent to
+ * perf: if not NULL the hardware counters are attached to the helper before it is given the command
+ * returns
+ * the pid running the command, or -1 if no helper could be used (the caller should fork instead)
+*/
+int zygote_launch(char** args, int out_fd, int err_fd, PerfCounters* perf);
+
+/*
+ * the body of a zygote helper, waits for a command on its socket and execs it. never returns
+ * params
+ * sock: the helper's end of its socket
+ * returns void
+*/
+void zygote_helper(int sock);
+
+/*
+ * closes every helper's socket, which makes the helpers exit
+ * params none
+ * returns void
+*/
+void zygote_shutdown(void);
+
+/*
+ * gets the number of milliseconds between two times
+ * params
+ * t0: the earlier time
+ * t1: the later time
+ * returns
+ * the elapsed time in milliseconds
+*/
+int elapsed_ms(struct timeval* t0, struct timeval* t1);
+
 int main(int argc, char* argv[])
 {
 	if (argc == 1)
@@ -109,68 +608,25 @@ int main(int argc, char* argv[])
 		prompt[2] = '>';
 		prompt[3] = '\0';
 
-		bool mapped_memory_successfully = true;
-
-		jobs = mmap(NULL, sizeof(Job*) * MAX_NUM_JOBS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		arena = mmap(NULL, sizeof(SharedArena), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 
-		if (jobs == NULL)
+		if (arena == MAP_FAILED)
 		{
 			printf("Could not map shared memory\n");
 			return 1;
 		}
 
-		for (int i = 0; i < MAX_NUM_JOBS; i++)
+		// a fresh anonymous mapping is zeroed, so only the ring's sequence numbers need setting up
+		for (int i = 0; i < COMPLETION_RING_SIZE; i++)
 		{
-			jobs[i] = mmap(NULL, sizeof(Job), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-
-			if (jobs[i] == NULL)
-			{
-				mapped_memory_successfully = false;
-				continue;
-			}
-
-			jobs[i]->name = mmap(NULL, sizeof(char) * MAX_COMMAND_LEN + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-			jobs[i]->usage = mmap(NULL, sizeof(struct rusage), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-
-			if (jobs[i]->name == NULL || jobs[i]->usage == NULL)
-			{
-				mapped_memory_successfully = false;
-			}
+			atomic_init(&arena->ring[i].seq, i);
 		}
 
-		num_jobs = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-		*num_jobs = 0;
-
-		job_number = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-		*job_number = 1;
-
-		shared_mem_in_use = mmap(NULL, sizeof(bool), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-		*shared_mem_in_use = false;
-
-		finished_pids = mmap(NULL, sizeof(int) * MAX_NUM_FINISHED_JOBS + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-		finished_pids[0] = -1;
-
-		if (!mapped_memory_successfully || num_jobs == NULL || job_number == NULL || shared_mem_in_use == NULL || finished_pids == NULL)
+		// pushed in reverse so the first job gets the first entry of the table
+		for (int i = MAX_NUM_JOBS - 1; i >= 0; i--)
 		{
-			printf("Could not map shared memory\n");
-
-			for (int i = 0; i < *num_jobs; i++)
-			{
-				if (jobs[i] != NULL)
-				{
-					munmap(jobs[i]->name, sizeof(char) * MAX_COMMAND_LEN + 1);
-					munmap(jobs[i]->usage, sizeof(struct rusage));
-					munmap(jobs[i], sizeof(Job));
-				}
-			}
-			munmap(jobs, sizeof(Job*) * MAX_NUM_JOBS);
-			munmap(num_jobs, sizeof(int));
-			munmap(job_number, sizeof(int));
-
-			munmap(finished_pids, sizeof(int) * MAX_NUM_FINISHED_JOBS);
-			munmap(shared_mem_in_use, sizeof(bool));
-
-			return 1;
+			free_jobs[num_free_jobs++] = i;
+			capture_fds[i] = -1;
 		}
 
 		// because our parent process does not wait for children when they are background tasks, we need the os the reap them so they 
@@ -181,21 +637,29 @@ int main(int argc, char* argv[])
 		while (1)
 		{
 			char* input = get_input(prompt);
+			if (input == NULL)
+			{
+				// the end of input (ctrl-d, or the end of a script piped in) is treated like "exit"
+				printf("\n");
+				input = strdup("exit");
+			}
+
 			char** args = get_args(input);
 			free(input);
 
 			check_finished_processes();
 
-			if (!strcmp(args[0], "exit"))
+			if (args[0] == NULL)
 			{
-				for (int i = 0; args[i] != NULL; i++)
-				{
-					free(args[i]);
-				}
+				free(args);
+				continue;
+			}
 
-				free(args);			
+			if (!strcmp(args[0], "exit"))
+			{
+				free(args);
 
-				while (*num_jobs > 0)
+				while (num_jobs > 0)
 				{
 					check_finished_processes();
 					usleep(1);
@@ -210,7 +674,7 @@ int main(int argc, char* argv[])
 					printf("Could not change directory\n");
 				}
 			}
-			else if (!strcmp(args[0], "set") && !strcmp(args[1], "prompt") && !strcmp(args[2], "="))
+			else if (!strcmp(args[0], "set") && args[1] != NULL && !strcmp(args[1], "prompt") && args[2] != NULL && !strcmp(args[2], "=") && args[3] != NULL)
 			{
 				free(prompt);
 
@@ -231,11 +695,66 @@ int main(int argc, char* argv[])
 
 				prompt[len - 1] = '\0';
 			}
+			else if (!strcmp(args[0], "set") && args[1] != NULL && !strcmp(args[1], "perf") && args[2] != NULL && !strcmp(args[2], "=") && args[3] != NULL)
+			{
+				perf_enabled = !strcmp(args[3], "on");
+			}
+			else if (!strcmp(args[0], "set") && args[1] != NULL && !strcmp(args[1], "zygote") && args[2] != NULL && !strcmp(args[2], "=") && args[3] != NULL)
+			{
+				zygote_enabled = !strcmp(args[3], "on");
+				if (!zygote_enabled)
+				{
+					zygote_shutdown();
+				}
+			}
+			else if (!strcmp(args[0], "set") && args[1] != NULL && !strcmp(args[1], "capture") && args[2] != NULL && !strcmp(args[2], "=") && args[3] != NULL)
+			{
+				capture_enabled = !strcmp(args[3], "on");
+			}
+			else if (!strcmp(args[0], "tail"))
+			{
+				// tail <job number> [lines]
+				int job_num = args[1] == NULL ? -1 : atoi(args[1]);
+				int lines = args[1] == NULL || args[2] == NULL ? DEFAULT_TAIL_LINES : atoi(args[2]);
+
+				int slot;
+				for (slot = first_job; slot != -1 && arena->jobs[slot].job_num != job_num; slot = next_job[slot]) {}
+
+				if (job_num == -1 || lines <= 0)
+				{
+					printf("Usage: tail <job number> [lines]\n");
+				}
+				else if (slot == -1)
+				{
+					printf("No running job [%d]\n", job_num);
+				}
+				else if (capture_fds[slot] == -1)
+				{
+					printf("The output of job [%d] is not being captured\n", job_num);
+				}
+				else
+				{
+					print_captured(slot, lines);
+				}
+			}
+			else if (!strcmp(args[0], "bench"))
+			{
+				run_bench(args);
+			}
 			else if (!strcmp(args[0], "jobs"))
 			{
-				for (int i = 0; i < *num_jobs; i++)
+				for (int i = first_job; i != -1; i = next_job[i])
 				{
-					printf("[%d] %d %s\n", jobs[i]->job_num, jobs[i]->pid, jobs[i]->name);
+					Job* job = &arena->jobs[i];
+					printf("[%d] %d %s CPU: %.1f%% RSS: %ldKB", job->job_num, job->pid, job->name, job->cpu_percent, job->rss_kb);
+					if (job->read_rate == -1)
+					{
+						printf(" Read: n/a Write: n/a\n");
+					}
+					else
+					{
+						printf(" Read: %.1fKB/s Write: %.1fKB/s\n", job->read_rate / 1024, job->write_rate / 1024);
+					}
 				}
 			}
 			else
@@ -248,13 +767,12 @@ int main(int argc, char* argv[])
 
 				if (!strcmp(args[last_arg_index], "&"))
 				{
-					if (*num_jobs == MAX_NUM_JOBS)
+					if (num_jobs == MAX_NUM_JOBS)
 					{
 						printf("Could not execute, max number of background jobs reached\n");
 					}
 					else
 					{
-						free(args[last_arg_index]);
 						args[last_arg_index] = NULL;
 						execute_command(args, true);
 					}
@@ -265,85 +783,200 @@ int main(int argc, char* argv[])
 				}
 			}
 
-			for (int i = 0; args[i] != NULL; i++)
-			{
-				free(args[i]);
-			}
-
 			free(args);
 		}
 
 		free(prompt);
+		zygote_shutdown();
 
-		for (int i = 0; i < *num_jobs; i++)
-		{
-			munmap(jobs[i]->name, sizeof(char) * MAX_COMMAND_LEN + 1);
-			munmap(jobs[i]->usage, sizeof(struct rusage));
-			munmap(jobs[i], sizeof(Job));
-		}
-		munmap(jobs, sizeof(Job*) * MAX_NUM_JOBS);
-		munmap(num_jobs, sizeof(int));
-		munmap(job_number, sizeof(int));
-
-		munmap(finished_pids, sizeof(int) * MAX_NUM_FINISHED_JOBS);
-		munmap(shared_mem_in_use, sizeof(bool));
+		munmap(arena, sizeof(SharedArena));
 	}
 	else
 	{
-		char** args = malloc(sizeof(char*) * argc);
+		char* script = NULL;
+		int max_parallel = DEFAULT_BATCH_JOBS;
+
+		// the '+' stops option parsing at the first non option so that "./doit ls -l" still runs "ls -l"
+		int opt;
+		while ((opt = getopt(argc, argv, "+f:j:pz")) != -1)
+		{
+			if (opt == 'f')
+			{
+				script = optarg;
+			}
+			else if (opt == 'p')
+			{
+				perf_enabled = true;
+			}
+			else if (opt == 'z')
+			{
+				zygote_enabled = true;
+			}
+			else if (opt == 'j')
+			{
+				max_parallel = atoi(optarg);
+				if (max_parallel <= 0)
+				{
+					printf("Number of parallel commands must be a positive integer\n");
+					return 1;
+				}
+			}
+			else
+			{
+				printf("Usage: ./doit [-p] [-z] [-f script [-j num_parallel]] [command]\n");
+				return 1;
+			}
+		}
+
+		if (script != NULL)
+		{
+			int ret = !run_batch(script, max_parallel);
+			zygote_shutdown();
+			return ret;
+		}
+
+		if (optind == argc)
+		{
+			printf("No command given\n");
+			return 1;
+		}
+
+		char** args = malloc(sizeof(char*) * (argc - optind + 1));
 		
-		for (int i = 1; i < argc; i++)
+		for (int i = optind; i < argc; i++)
 		{
-			args[i - 1] = argv[i];
+			args[i - optind] = argv[i];
 		}
 
-		args[argc - 1] = NULL;
+		args[argc - optind] = NULL;
 
 		execute_command(args, false);
 		free(args);
+		zygote_shutdown();
 	}
 }
 
 int execute_command(char** args, bool background)
 {
-	// if this is a background task, we will fork twice, the first child will gather information about the execution and add the job to
-	// the jobs array, the grandchild will actually perform the execution
+	// if this is a background task, we will fork twice, the first child will gather information about the execution and fill in
+	// the job's entry in the job table, the grandchild will actually perform the execution
 	if (background)
 	{
-		// this boolean will become true when the 1st child as forked to start the execution and then printed the line telling the user
-		// the pid of the background task. we need the parent to wait until this becomes true in order to prevent the parent from printing something else
-		// before the 1st child prints that pid
-		bool* done = mmap(NULL, sizeof(bool), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		// the entry is claimed before forking, so the child knows where to write without any locking. the caller has already
+		// checked that there is a free one
+		int slot = free_jobs[--num_free_jobs];
+		Job* job = &arena->jobs[slot];
 
-		if (done == NULL)
+		int i;
+		for (i = 0; args[0][i] != '\0' && i < MAX_COMMAND_LEN; i++)
 		{
-			printf("Could not map shared memory\n");
-			return 0;
+			job->name[i] = args[0][i];
+		}
+		job->name[i] = '\0';
+
+		job->job_num = job_number;
+		job->has_perf = false;
+		job->series_len = 0;
+		job->pending_samples = 0;
+		job->pending_rss = 0;
+		job->pending_cpu = 0;
+		job->series_interval_ms = SAMPLE_INTERVAL_MS;
+		job->cpu_percent = 0;
+		job->rss_kb = 0;
+		job->peak_rss_kb = 0;
+		job->read_rate = -1;
+		job->write_rate = -1;
+		job->read_bytes = -1;
+		job->write_bytes = -1;
+		atomic_store(&job->pid, 0);
+
+		job->captured = false;
+		atomic_store(&job->memory_len, 0);
+		atomic_store(&job->spill_len, 0);
+		job->spill_path[0] = '\0';
+		if (capture_enabled)
+		{
+			capture_fds[slot] = memfd_create("doit-job", MFD_CLOEXEC);
+			if (capture_fds[slot] == -1)
+			{
+				printf("Could not create memfd, output of job [%d] will not be captured\n", job->job_num);
+			}
+			job->captured = capture_fds[slot] != -1;
 		}
 
-		*done = false;
+		// otherwise the child would also print whatever is still buffered when it exits
+		fflush(stdout);
 
 		int pid2 = fork();
 
 		if (pid2 < 0)
 		{
 			printf("Could not fork\n");
+			release_capture(slot);
+			free_jobs[num_free_jobs++] = slot;
 			return 0;
 		}
 		else if (pid2 == 0)
 		{
 			// child
 
+			// this process never hands out commands, and holding the helpers' sockets would keep them from exiting
+			zygote_shutdown();
+
+			// only this job's memfd is needed here
+			int memfd = capture_fds[slot];
+			for (int j = first_job; j != -1; j = next_job[j])
+			{
+				if (capture_fds[j] != -1)
+				{
+					close(capture_fds[j]);
+				}
+			}
+
+			int outpipe[2];
+			if (job->captured && pipe2(outpipe, O_CLOEXEC) == -1)
+			{
+				job->captured = false;
+			}
+
+			// so the grand child's counters can be attached before it runs, see attach_perf_counters()
+			int gate[2];
+			bool use_perf = perf_enabled && open_perf_gate(gate);
+
+			// turning off auto reap so we can wait for the grand child to finish in the child process. it has to happen
+			// before the fork, a grand child that exits before then is reaped by the os and wait_and_sample() gets ECHILD.
+			// SIGCHLD is blocked as well so its exit stays pending until wait_and_sample() looks for it
+			sigset_t chld;
+			sigemptyset(&chld);
+			sigaddset(&chld, SIGCHLD);
+			signal(SIGCHLD, SIG_DFL);
+			sigprocmask(SIG_BLOCK, &chld, NULL);
+
 			int pid = fork();
 
 			if (pid < 0)
 			{
-				printf("Could not fork\n");
-				return 0;
+				atomic_store_explicit(&job->pid, -1, memory_order_release);
+				exit(0);
 			}
 			else if (pid == 0)
 			{
 				// grand child
+
+				// the blocked mask would otherwise carry over into the command
+				sigprocmask(SIG_UNBLOCK, &chld, NULL);
+
+				if (job->captured)
+				{
+					dup2(outpipe[1], STDOUT_FILENO);
+					dup2(outpipe[1], STDERR_FILENO);
+				}
+
+				if (use_perf)
+				{
+					wait_at_perf_gate(gate);
+				}
+
 				execvp(args[0], args);
 				printf("execvp() failed, command was not run\n");
 				exit(0);
@@ -352,59 +985,41 @@ int execute_command(char** args, bool background)
 			{
 				// child
 
-				// turning off auto reap so we can wait for the grand child to finish in the child process
-				signal(SIGCHLD, SIG_DFL);
-
-				// getting the time for when the process starts, filling in information about the process
-				// then waiting for the process to finish, getting the time when the process finishes, and adding it to finished_pids
-				struct timeval t0;
-				struct timeval t1;
-				if (gettimeofday(&t0, NULL) == -1)
+				int out_fd = -1;
+				if (job->captured)
 				{
-					printf("first gettimeofday() failed, cannot track wall time for job [%d]\n", pid);
-					t0.tv_sec = -1;
+					close(outpipe[1]);
+					out_fd = outpipe[0];
 				}
 
-				while (*shared_mem_in_use)
+				PerfCounters perf;
+				if (use_perf)
 				{
-					usleep(1);
+					attach_perf_counters(pid, gate, &perf);
 				}
 
-				*shared_mem_in_use = true;
-
-				printf("[%d] %d\n", *job_number, pid);
-				*done = true;
-
-				int i;
-				for (i = 0; args[0][i] != '\0'; i++)
+				// getting the time for when the process starts, then waiting for the process to finish, getting the time when the
+				// process finishes, and adding it to the completion ring
+				struct timeval t0;
+				struct timeval t1;
+				if (gettimeofday(&t0, NULL) == -1)
 				{
-					jobs[*num_jobs]->name[i] = args[0][i];
+					printf("first gettimeofday() failed, cannot track wall time for job [%d]\n", pid);
+					t0.tv_sec = -1;
 				}
-				jobs[*num_jobs]->name[i] = '\0';
-
-				jobs[*num_jobs]->pid = pid;
-				jobs[*num_jobs]->job_num = *job_number;
-
-				*num_jobs = *num_jobs + 1;	
-				*job_number = *job_number + 1;
 
-				*shared_mem_in_use = false;
+				// lets the parent print the pid and go back to the prompt
+				atomic_store_explicit(&job->pid, pid, memory_order_release);
 
-				// we have now gathered all the pre execution information and added it to the jobs array so we will wait for the child
-				// to finish the actual bash execution
+				// we will sample the child until it finishes the actual bash execution
 				int status;
-				int ret;
-				do
-				{
-					ret = wait4(pid, &status, 0, jobs[*num_jobs - 1]->usage);
-				}
-				while (ret == -1 && errno == EINTR);
+				int ret = wait_and_sample(pid, job, &status, out_fd, memfd);
 
 				if (ret == -1)
 				{
 					if (errno == ECHILD)
 					{
-						jobs[*num_jobs - 1]->usage->ru_utime.tv_sec = -1;
+						job->usage.ru_utime.tv_sec = -1;
 					}
 				}
 
@@ -414,54 +1029,63 @@ int execute_command(char** args, bool background)
 					t1.tv_sec = -1;
 				}
 
-				while (*shared_mem_in_use)
+				if (t0.tv_sec == -1 || t1.tv_sec == -1)
 				{
-					usleep(1);
+					job->time = -1;
 				}
-
-				*shared_mem_in_use = true;
-
-				// this is a failsafe for if a bump occurs in the job array from a check_finished_process(), 
-				// which would make the index in the job array that we are dealing with different than *num_jobs - 1
-				for (i = 0; i < *num_jobs; i++)
+				else
 				{
-					if (jobs[i]->pid == pid)
-					{
-						break;
-					}
+					job->time = ((t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec) / 1000;
 				}
 
-				if (t0.tv_sec == -1 || t1.tv_sec == -1)
-				{
-					jobs[i]->time = -1;
-				}
-				else
+				job->has_perf = use_perf;
+				if (use_perf)
 				{
-					jobs[i]->time = ((t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec) / 1000;
+					collect_perf_counters(&perf);
+					job->perf = perf;
 				}
 
 				fflush(stdout);
 
-				// this process is now complete so we add it to finished_pids
-				for (i = 0; finished_pids[i] != -1; i++) {}
-
-				finished_pids[i] = pid;
-				finished_pids[i + 1] = -1;
-
-				*shared_mem_in_use = false;
+				// this process is now complete so we hand it to the shell
+				push_completion(slot);
 
 				exit(0);
 			}
 		}
 		else
 		{
-			// waiting for the child to give the go ahead for continuing the execution
-			while (!(*done))
+			// waiting for the child to report the pid, it is printed before anything else so the user knows which job it is
+			int pid;
+			while ((pid = atomic_load_explicit(&job->pid, memory_order_acquire)) == 0)
 			{
 				usleep(1);
 			}
 
-			munmap(done, sizeof(bool));
+			if (pid == -1)
+			{
+				printf("Could not fork\n");
+				release_capture(slot);
+				free_jobs[num_free_jobs++] = slot;
+				return 0;
+			}
+
+			printf("[%d] %d\n", job->job_num, pid);
+
+			next_job[slot] = -1;
+			prev_job[slot] = last_job;
+			if (last_job == -1)
+			{
+				first_job = slot;
+			}
+			else
+			{
+				next_job[last_job] = slot;
+			}
+			last_job = slot;
+
+			num_jobs++;
+			job_number++;
 
 			return 1;
 		}
@@ -469,18 +1093,46 @@ int execute_command(char** args, bool background)
 	else
 	{
 		// if we aren't handling a background task this is very simple, we will just create a child to execute the process while
-		// the parent gathers information about said process
-		int pid = fork();
+		// the parent gathers information about said process. in zygote mode a waiting helper takes the place of the fork
+		// turning off auto reap so we can wait for the child (since this isnt a background process). this has to happen before
+		// the child can exit, a child that exits while SIGCHLD is ignored is reaped by the os and wait4() fails
+		signal(SIGCHLD, SIG_DFL);
+
+		PerfCounters perf;
+		int pid = -1;
+		if (zygote_enabled)
+		{
+			pid = zygote_launch(args, STDOUT_FILENO, STDERR_FILENO, perf_enabled ? &perf : NULL);
+		}
+		bool from_zygote = pid != -1;
+
+		int gate[2];
+		bool use_perf = perf_enabled && (from_zygote || open_perf_gate(gate));
+
+		if (!from_zygote)
+		{
+			pid = fork();
+		}
 
 		if (pid < 0)
 		{
 			printf("Could not fork\n");
+			signal(SIGCHLD, SIG_IGN);
+			if (use_perf)
+			{
+				close_perf_gate(gate);
+			}
 			return 0;
 		}
 		else if (pid == 0)
 		{
 			// child
 
+			if (use_perf)
+			{
+				wait_at_perf_gate(gate);
+			}
+
 			execvp(args[0], args);
 			printf("execvp() failed, command was not run\n");
 			exit(0);
@@ -488,9 +1140,12 @@ int execute_command(char** args, bool background)
 		else
 		{
 			// parent
-			
-			// turning off auto reap so we can wait for the child (since this isnt a background process)
-			signal(SIGCHLD, SIG_DFL);
+
+			if (use_perf && !from_zygote)
+			{
+				attach_perf_counters(pid, gate, &perf);
+			}
+
 			struct timeval t0;
 			struct timeval t1;
 			if (gettimeofday(&t0, NULL) == -1)
@@ -499,6 +1154,11 @@ int execute_command(char** args, bool background)
 				t0.tv_sec = -1;
 			}
 
+			if (from_zygote)
+			{
+				zygote_refill();
+			}
+
 			int status;
 			int ret;
 			struct rusage usage;
@@ -535,6 +1195,12 @@ int execute_command(char** args, bool background)
 				print_stats(&usage, ((t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec) / 1000);
 			}
 
+			if (use_perf)
+			{
+				collect_perf_counters(&perf);
+				print_perf(&perf);
+			}
+
 			// turning auto reap back on
 			signal(SIGCHLD, SIG_IGN);
 
@@ -546,38 +1212,103 @@ int execute_command(char** args, bool background)
 char* get_input(char* prompt)
 {
 	printf("%s", prompt);
-	char* s = malloc(sizeof(char) * (MAX_COMMAND_LEN + 1));
-	fgets(s, 128, stdin);
+	fflush(stdout);
+
+	char* s = NULL;
+	size_t cap = 0;
+	if (getline(&s, &cap, stdin) == -1)
+	{
+		free(s);
+		return NULL;
+	}
+
 	return s;
 }
 
 char** get_args(char* cmd)
 {
-	char** args = malloc(sizeof(char*) * 33);
+	size_t len = strlen(cmd);
+
+	// arguments are separated by at least one character, so there are at most len / 2 + 1 of them, and quotes and escapes
+	// only ever shrink an argument, so their characters plus terminators fit in len + 1 bytes
+	size_t max_args = len / 2 + 1;
+	char** args = malloc(sizeof(char*) * (max_args + 1) + len + 1);
+	char* out = (char*) (args + max_args + 1);
 
-	int start_of_arg = 0;
 	int num_args = 0;
+	bool in_arg = false;
+	char quote = '\0';
 
-	for (int i = 0; 1; i++)
+	for (char* c = cmd; *c != '\0'; c++)
 	{
-		if (cmd[i] == ' ' || cmd[i] == '\n')
+		if (quote == '\'')
 		{
-			int len = i - start_of_arg + 1;
-			char* arg = malloc(sizeof(char) * len);
-			arg[len - 1] = '\0';
-			for (int j = i - 1; j >= start_of_arg; j--)
+			if (*c == '\'')
 			{
-				arg[j - i - 1 + len] = cmd[j];
+				quote = '\0';
 			}
-			args[num_args] = arg;
-			num_args++;
-			start_of_arg = i + 1;
+			else
+			{
+				*out++ = *c;
+			}
+			continue;
+		}
 
-			if (cmd[i] == '\n')
+		if (quote == '"')
+		{
+			if (*c == '"')
 			{
-				break;
+				quote = '\0';
+			}
+			else if (*c == '\\' && (c[1] == '\\' || c[1] == '"' || c[1] == '$' || c[1] == '`'))
+			{
+				*out++ = *++c;
+			}
+			else
+			{
+				*out++ = *c;
+			}
+			continue;
+		}
+
+		if (*c == ' ' || *c == '\t' || *c == '\n')
+		{
+			if (in_arg)
+			{
+				*out++ = '\0';
+				in_arg = false;
 			}
+			continue;
 		}
+
+		if (!in_arg)
+		{
+			args[num_args++] = out;
+			in_arg = true;
+		}
+
+		if (*c == '\'' || *c == '"')
+		{
+			quote = *c;
+		}
+		else if (*c == '\\' && c[1] != '\0')
+		{
+			*out++ = *++c;
+		}
+		else
+		{
+			*out++ = *c;
+		}
+	}
+
+	if (quote != '\0')
+	{
+		printf("Unterminated %c quote, command was not run\n", quote);
+		num_args = 0;
+	}
+	else if (in_arg)
+	{
+		*out = '\0';
 	}
 
 	args[num_args] = NULL;
@@ -587,62 +1318,89 @@ char** get_args(char* cmd)
 
 void check_finished_processes(void)
 {
-	while (*shared_mem_in_use)
+	int slot;
+	while ((slot = pop_completion()) != -1)
 	{
-		usleep(1);
-	}
+		Job* job = &arena->jobs[slot];
 
-	*shared_mem_in_use = true;
-
-	// searching for each finished pid in the jobs array
-	for (int i = 0; finished_pids[i] != -1; i++)
-	{
-		bool found = false;
-		int j;
-		for (j = 0; j < *num_jobs; j++)
+		printf("[%d] %d Completed\n", job->job_num, atomic_load(&job->pid));
+		if (capture_fds[slot] != -1)
 		{
-			if (jobs[j]->pid == finished_pids[i])
-			{
-				found = true;
-				break;
-			}
+			print_captured(slot, -1);
+			release_capture(slot);
+		}
+		print_stats(&job->usage, job->time);
+		print_job_samples(job);
+		if (job->has_perf)
+		{
+			print_perf(&job->perf);
 		}
 
-		if (found)
+		// unlinking it from the active jobs and giving its entry back
+		if (prev_job[slot] == -1)
+		{
+			first_job = next_job[slot];
+		}
+		else
 		{
-			printf("[%d] %d Completed\n", jobs[j]->job_num, finished_pids[i]);
-			print_stats(jobs[j]->usage, jobs[j]->time);
+			next_job[prev_job[slot]] = next_job[slot];
+		}
 
-			for (; j < *num_jobs - 1; j++)
-			{
-				// this bumps the pointer to the completed job to the end of the job array
-				// and moves the other elements down to replace it. if we do not bump the finished element to the end,
-				// we will have a memory leak as some of the elements in the jobs array will point to same job, and others
-				// will be lost (remember, these are pointers to different chunks of allocated memory which are not deep copied or ever freed/realloced until the end)
-				Job* tmp = jobs[j];
-				jobs[j] = jobs[j + 1];
-				jobs[j + 1] = tmp;
-			}
-			*num_jobs = *num_jobs - 1;
+		if (next_job[slot] == -1)
+		{
+			last_job = prev_job[slot];
 		}
 		else
 		{
-			printf("Could not find pid [%d] in jobs array\n", finished_pids[i]);
-			break;
+			prev_job[next_job[slot]] = prev_job[slot];
 		}
+
+		free_jobs[num_free_jobs++] = slot;
+		num_jobs--;
+	}
+
+	if (num_jobs == 0)
+	{
+		job_number = 1;
+	}
+}
+
+void push_completion(int job)
+{
+	// claiming a position, the ring is at least as big as the job table so the slot there is always free by now
+	unsigned long pos = atomic_fetch_add_explicit(&arena->ring_tail, 1, memory_order_relaxed);
+	CompletionSlot* slot = &arena->ring[pos & (COMPLETION_RING_SIZE - 1)];
+
+	while (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos)
+	{
+		usleep(1);
 	}
 
-	// note: this line means that when a pid is not found in the array on its first check, it will not check again
-	// this should never be an issue given that a job is always added before its added to finished_pids, but none the less
-	// it is important to point out
-	finished_pids[0] = -1;
+	slot->job = job;
+
+	// publishes the job, and with it everything written to its entry in the job table
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+int pop_completion(void)
+{
+	unsigned long pos = arena->ring_head;
+	CompletionSlot* slot = &arena->ring[pos & (COMPLETION_RING_SIZE - 1)];
 
-	if (*num_jobs == 0)
+	// a producer that has claimed this position but not finished writing it looks the same as an empty ring, its job is
+	// picked up on the next check
+	if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
 	{
-		*job_number = 1;
+		return -1;
 	}
 
-	*shared_mem_in_use = false;
+	int job = slot->job;
+
+	// hands the slot back for the producer one lap around the ring
+	atomic_store_explicit(&slot->seq, pos + COMPLETION_RING_SIZE, memory_order_release);
+	arena->ring_head = pos + 1;
+
+	return job;
 }
 
 void print_stats(struct rusage* usage, int time)
@@ -662,5 +1420,1647 @@ void print_stats(struct rusage* usage, int time)
 		printf("Voluntary CPU Give Ups: %ld\n", usage->ru_nvcsw);
 		printf("Minor Page Faults: %ld\n", usage->ru_minflt);
 		printf("Major Page Faults: %ld\n", usage->ru_majflt);
+		printf("Max Resident Set Size: %ldKB\n", usage->ru_maxrss);
+	}
+}
+
+int run_batch(char* filename, int max_parallel)
+{
+	FILE* f = fopen(filename, "r");
+
+	if (f == NULL)
+	{
+		printf("Could not open script\n");
+		return 0;
+	}
+
+	// reading every command up front so we know how many there are
+	int num_cmds = 0;
+	int cmds_cap = 16;
+	BatchJob* cmds = malloc(sizeof(BatchJob) * cmds_cap);
+
+	char* line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &line_cap, f)) != -1)
+	{
+		if (len > 0 && line[len - 1] == '\n')
+		{
+			line[--len] = '\0';
+		}
+
+		if (len == 0 || line[0] == '#')
+		{
+			continue;
+		}
+
+		char** args = get_args(line);
+		if (args[0] == NULL)
+		{
+			free(args);
+			continue;
+		}
+
+		if (num_cmds == cmds_cap)
+		{
+			cmds_cap *= 2;
+			cmds = realloc(cmds, sizeof(BatchJob) * cmds_cap);
+		}
+
+		BatchJob* job = &cmds[num_cmds];
+		memset(job, 0, sizeof(BatchJob));
+		job->cmd = strdup(line);
+		job->fd = -1;
+		job->args = args;
+
+		num_cmds++;
+	}
+
+	free(line);
+	fclose(f);
+
+	struct timeval t0;
+	struct timeval t1;
+	gettimeofday(&t0, NULL);
+
+	struct pollfd* fds = malloc(sizeof(struct pollfd) * max_parallel);
+	int* fd_owners = malloc(sizeof(int) * max_parallel);
+
+	int next_to_start = 0;
+	int next_to_print = 0;
+	int num_running = 0;
+	bool all_started = true;
+
+	while (next_to_print < num_cmds)
+	{
+		// a command that closed its output before exiting is only reaped once it has exited, so it never holds up the others
+		for (int i = next_to_print; i < next_to_start; i++)
+		{
+			if (cmds[i].fd == -1 && !cmds[i].finished)
+			{
+				reap_batch_job(&cmds[i]);
+				if (cmds[i].finished)
+				{
+					num_running--;
+				}
+			}
+		}
+
+		while (num_running < max_parallel && next_to_start < num_cmds)
+		{
+			if (start_batch_job(&cmds[next_to_start]))
+			{
+				num_running++;
+			}
+			else
+			{
+				// nothing to wait on, it still gets reported in order with empty stats
+				all_started = false;
+				cmds[next_to_start].finished = true;
+				cmds[next_to_start].usage.ru_utime.tv_sec = -1;
+				cmds[next_to_start].time = -1;
+			}
+			next_to_start++;
+		}
+
+		int nfds = 0;
+		bool exiting = false;
+		for (int i = next_to_print; i < next_to_start; i++)
+		{
+			if (cmds[i].fd != -1)
+			{
+				fds[nfds].fd = cmds[i].fd;
+				fds[nfds].events = POLLIN;
+				fd_owners[nfds] = i;
+				nfds++;
+			}
+			else if (!cmds[i].finished)
+			{
+				exiting = true;
+			}
+		}
+
+		if (nfds > 0 || exiting)
+		{
+			if (poll(fds, nfds, exiting ? BATCH_REAP_MS : -1) == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				printf("poll() failed, aborting batch run\n");
+				break;
+			}
+
+			for (int i = 0; i < nfds; i++)
+			{
+				if (fds[i].revents != 0)
+				{
+					read_batch_output(&cmds[fd_owners[i]]);
+					if (cmds[fd_owners[i]].finished)
+					{
+						num_running--;
+					}
+				}
+			}
+		}
+
+		// the output of a command is only shown once every command before it has been shown, so the output stays in script order
+		while (next_to_print < num_cmds && cmds[next_to_print].finished)
+		{
+			BatchJob* job = &cmds[next_to_print];
+			printf("[%d] %s\n", next_to_print + 1, job->cmd);
+			fflush(stdout);
+			if (job->output_len > 0)
+			{
+				fwrite(job->output, 1, job->output_len, stdout);
+			}
+			print_stats(&job->usage, job->time);
+			if (perf_enabled && job->pid != 0)
+			{
+				print_perf(&job->perf);
+			}
+			next_to_print++;
+		}
+	}
+
+	gettimeofday(&t1, NULL);
+
+	// aggregate report
+	long user_ms = 0;
+	long system_ms = 0;
+	for (int i = 0; i < num_cmds; i++)
+	{
+		if (cmds[i].usage.ru_utime.tv_sec != -1)
+		{
+			user_ms += (1000*cmds[i].usage.ru_utime.tv_sec) + (cmds[i].usage.ru_utime.tv_usec / 1000);
+			system_ms += (1000*cmds[i].usage.ru_stime.tv_sec) + (cmds[i].usage.ru_stime.tv_usec / 1000);
+		}
+	}
+
+	printf("-->Batch Stats<--\n");
+	printf("Commands Run: %d (%d at a time)\n", num_cmds, max_parallel);
+	int wall = elapsed_ms(&t0, &t1);
+	printf("Total Wall Time: %dms\n", wall);
+	printf("Commands Per Second: %.1f%s\n", wall > 0 ? num_cmds * 1000.0 / wall : 0.0, zygote_enabled ? " (zygote)" : "");
+	printf("Summed User CPU Time: %ldms\n", user_ms);
+	printf("Summed System CPU Time: %ldms\n", system_ms);
+	printf("Summed CPU Time: %ldms\n", user_ms + system_ms);
+
+	// selection of the slowest commands, the list is short so repeatedly picking the max is fine
+	int num_slowest = num_cmds < NUM_SLOWEST_REPORTED ? num_cmds : NUM_SLOWEST_REPORTED;
+	bool* reported = calloc(num_cmds, sizeof(bool));
+	printf("Slowest Commands:\n");
+	for (int n = 0; n < num_slowest; n++)
+	{
+		int slowest = -1;
+		for (int i = 0; i < num_cmds; i++)
+		{
+			if (!reported[i] && (slowest == -1 || cmds[i].time > cmds[slowest].time))
+			{
+				slowest = i;
+			}
+		}
+		reported[slowest] = true;
+		printf("  %dms [%d] %s\n", cmds[slowest].time, slowest + 1, cmds[slowest].cmd);
+	}
+
+	free(reported);
+	free(fds);
+	free(fd_owners);
+
+	for (int i = 0; i < num_cmds; i++)
+	{
+		free(cmds[i].args);
+		free(cmds[i].cmd);
+		free(cmds[i].output);
+	}
+	free(cmds);
+
+	return all_started;
+}
+
+int start_batch_job(BatchJob* job)
+{
+	int pipefd[2];
+
+	// close on exec so the other commands of the batch don't hold each other's pipes open
+	if (pipe2(pipefd, O_CLOEXEC) == -1)
+	{
+		printf("Could not create pipe for \"%s\"\n", job->cmd);
+		return 0;
+	}
+
+	// anything still buffered would otherwise be printed a second time by a child whose execvp() fails
+	fflush(stdout);
+
+	gettimeofday(&job->start, NULL);
+
+	int pid = -1;
+	if (zygote_enabled)
+	{
+		pid = zygote_launch(job->args, pipefd[1], pipefd[1], perf_enabled ? &job->perf : NULL);
+	}
+	bool from_zygote = pid != -1;
+
+	int gate[2];
+	bool use_perf = perf_enabled && (from_zygote || open_perf_gate(gate));
+
+	if (!from_zygote)
+	{
+		pid = fork();
+	}
+
+	if (pid < 0)
+	{
+		printf("Could not fork\n");
+		close(pipefd[0]);
+		close(pipefd[1]);
+		if (use_perf)
+		{
+			close_perf_gate(gate);
+		}
+		return 0;
+	}
+	else if (pid == 0)
+	{
+		// child
+		dup2(pipefd[1], STDOUT_FILENO);
+		dup2(pipefd[1], STDERR_FILENO);
+
+		if (use_perf)
+		{
+			wait_at_perf_gate(gate);
+		}
+
+		execvp(job->args[0], job->args);
+		printf("execvp() failed, command was not run\n");
+		exit(0);
+	}
+
+	close(pipefd[1]);
+
+	if (from_zygote)
+	{
+		zygote_refill();
+	}
+
+	if (use_perf)
+	{
+		if (!from_zygote)
+		{
+			attach_perf_counters(pid, gate, &job->perf);
+		}
+	}
+	else
+	{
+		// nothing to collect, print_perf() reports every counter as unavailable
+		for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+		{
+			job->perf.fds[i] = -1;
+		}
+	}
+
+	job->pid = pid;
+	job->fd = pipefd[0];
+
+	return 1;
+}
+
+void read_batch_output(BatchJob* job)
+{
+	if (job->output_cap - job->output_len < BATCH_READ_CHUNK)
+	{
+		size_t cap = job->output_cap * 2 + BATCH_READ_CHUNK;
+		char* output = realloc(job->output, cap);
+		if (output != NULL)
+		{
+			job->output = output;
+			job->output_cap = cap;
+		}
+	}
+
+	// out of memory, the rest of the output is read and dropped so the command does not block on a full pipe
+	char dropped[BATCH_READ_CHUNK];
+	char* buf = dropped;
+	size_t room = sizeof(dropped);
+	if (job->output_cap - job->output_len >= BATCH_READ_CHUNK)
+	{
+		buf = job->output + job->output_len;
+		room = job->output_cap - job->output_len;
+	}
+
+	ssize_t n = read(job->fd, buf, room);
+
+	if (n > 0)
+	{
+		if (buf != dropped)
+		{
+			job->output_len += n;
+		}
+		return;
+	}
+	if (n == -1 && errno == EINTR)
+	{
+		return;
+	}
+
+	// end of file (or a broken pipe), the command has closed its output but may keep running for a while after
+	close(job->fd);
+	job->fd = -1;
+
+	reap_batch_job(job);
+}
+
+void reap_batch_job(BatchJob* job)
+{
+	int status;
+	int ret;
+	do
+	{
+		ret = wait4(job->pid, &status, WNOHANG, &job->usage);
+	}
+	while (ret == -1 && errno == EINTR);
+
+	if (ret == 0)
+	{
+		return;
+	}
+
+	if (ret == -1)
+	{
+		job->usage.ru_utime.tv_sec = -1;
+	}
+
+	struct timeval t1;
+	gettimeofday(&t1, NULL);
+	job->time = elapsed_ms(&job->start, &t1);
+	job->finished = true;
+
+	collect_perf_counters(&job->perf);
+}
+
+int elapsed_ms(struct timeval* t0, struct timeval* t1)
+{
+	return ((t1->tv_sec-t0->tv_sec)*1000000 + t1->tv_usec-t0->tv_usec) / 1000;
+}
+
+int open_perf_gate(int gate[2])
+{
+	if (pipe2(gate, O_CLOEXEC) == -1)
+	{
+		printf("Could not create pipe, running without hardware counters\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+void close_perf_gate(int gate[2])
+{
+	close(gate[0]);
+	close(gate[1]);
+}
+
+void wait_at_perf_gate(int gate[2])
+{
+	close(gate[1]);
+
+	// returns once the parent closes its end
+	char c;
+	while (read(gate[0], &c, 1) == -1 && errno == EINTR) {}
+
+	close(gate[0]);
+}
+
+void attach_perf_counters(int pid, int gate[2], PerfCounters* perf)
+{
+	// only printed once, there is no point repeating it for every command
+	static bool warned = false;
+
+	static const unsigned long long configs[NUM_PERF_COUNTERS] =
+	{
+		[PERF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+		[PERF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+		[PERF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+		[PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	if (gate != NULL)
+	{
+		close(gate[0]);
+	}
+
+	int err = 0;
+	for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[i];
+		attr.disabled = 1;
+		attr.enable_on_exec = 1;
+		attr.inherit = 1;
+		// user space only, which is all perf_event_paranoid=2 (the usual default) allows
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		perf->fds[i] = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+		if (perf->fds[i] == -1 && err == 0)
+		{
+			err = errno;
+		}
+	}
+
+	if (err != 0 && !warned)
+	{
+		warned = true;
+
+		if (err == EACCES || err == EPERM)
+		{
+			int paranoid = -1;
+			FILE* f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+			if (f != NULL)
+			{
+				if (fscanf(f, "%d", &paranoid) != 1)
+				{
+					paranoid = -1;
+				}
+				fclose(f);
+			}
+			printf("Hardware counters not permitted (perf_event_paranoid = %d), running without them\n", paranoid);
+		}
+		else
+		{
+			printf("Some hardware counters are not supported on this machine: %s\n", strerror(err));
+		}
+	}
+
+	// letting the child continue on to execvp()
+	if (gate != NULL)
+	{
+		close(gate[1]);
+	}
+}
+
+void collect_perf_counters(PerfCounters* perf)
+{
+	perf->scaled = false;
+
+	for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		perf->values[i] = -1;
+
+		if (perf->fds[i] == -1)
+		{
+			continue;
+		}
+
+		// value, time enabled, time running
+		unsigned long long data[3];
+		if (read(perf->fds[i], data, sizeof(data)) == sizeof(data))
+		{
+			if (data[2] == 0)
+			{
+				// the counter never got onto the pmu
+				perf->values[i] = data[1] == 0 ? 0 : -1;
+			}
+			else if (data[2] < data[1])
+			{
+				// the counters were multiplexed, scale up to an estimate of the full run
+				perf->values[i] = (long long) ((double) data[0] * data[1] / data[2]);
+				perf->scaled = true;
+			}
+			else
+			{
+				perf->values[i] = data[0];
+			}
+		}
+
+		close(perf->fds[i]);
+		perf->fds[i] = -1;
+	}
+}
+
+void print_perf(PerfCounters* perf)
+{
+	static const char* names[NUM_PERF_COUNTERS] =
+	{
+		[PERF_CYCLES] = "CPU Cycles",
+		[PERF_INSTRUCTIONS] = "Instructions",
+		[PERF_CACHE_MISSES] = "Cache Misses",
+		[PERF_BRANCH_MISSES] = "Branch Misses"
+	};
+
+	bool any_available = false;
+	for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		any_available = any_available || perf->values[i] != -1;
+	}
+
+	if (!any_available)
+	{
+		printf("Hardware Counters: not available\n");
+		return;
+	}
+
+	for (int i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		if (perf->values[i] == -1)
+		{
+			printf("%s: not available\n", names[i]);
+		}
+		else
+		{
+			printf("%s: %lld%s\n", names[i], perf->values[i], perf->scaled ? " (scaled)" : "");
+		}
+
+		if (i == PERF_INSTRUCTIONS)
+		{
+			if (perf->values[PERF_CYCLES] > 0 && perf->values[PERF_INSTRUCTIONS] != -1)
+			{
+				printf("Instructions Per Cycle: %.2f\n", (double) perf->values[PERF_INSTRUCTIONS] / perf->values[PERF_CYCLES]);
+			}
+			else
+			{
+				printf("Instructions Per Cycle: not available\n");
+			}
+		}
+	}
+}
+
+int run_bench(char** args)
+{
+	static const char* names[NUM_BENCH_METRICS] =
+	{
+		[BENCH_WALL] = "wall_time",
+		[BENCH_USER] = "user_time",
+		[BENCH_SYSTEM] = "system_time",
+		[BENCH_MINOR_FAULTS] = "minor_faults",
+		[BENCH_MAJOR_FAULTS] = "major_faults",
+		[BENCH_VOLUNTARY_CS] = "voluntary_context_switches",
+		[BENCH_INVOLUNTARY_CS] = "involuntary_context_switches"
+	};
+
+	// times are stored in nanoseconds and shown in milliseconds in the text format
+	static const bool is_time[NUM_BENCH_METRICS] =
+	{
+		[BENCH_WALL] = true,
+		[BENCH_USER] = true,
+		[BENCH_SYSTEM] = true
+	};
+
+	int argc;
+	for (argc = 0; args[argc] != NULL; argc++) {}
+
+	int warmup = DEFAULT_BENCH_WARMUP;
+	int format = BENCH_TEXT;
+	char* out_path = NULL;
+
+	optind = 1;
+	int opt;
+	while ((opt = getopt(argc, args, "+w:f:o:")) != -1)
+	{
+		if (opt == 'w')
+		{
+			warmup = atoi(optarg);
+		}
+		else if (opt == 'f' && !strcmp(optarg, "text"))
+		{
+			format = BENCH_TEXT;
+		}
+		else if (opt == 'f' && !strcmp(optarg, "csv"))
+		{
+			format = BENCH_CSV;
+		}
+		else if (opt == 'f' && !strcmp(optarg, "json"))
+		{
+			format = BENCH_JSON;
+		}
+		else if (opt == 'o')
+		{
+			out_path = optarg;
+		}
+		else
+		{
+			optind = argc;
+			break;
+		}
+	}
+
+	int runs = optind < argc ? atoi(args[optind]) : 0;
+	if (runs <= 0 || warmup < 0 || optind + 1 >= argc)
+	{
+		printf("Usage: bench [-w warmup] [-f text|csv|json] [-o file] <runs> <command>\n");
+		return 0;
+	}
+
+	char** cmd = &args[optind + 1];
+
+	for (int i = 0; i < warmup; i++)
+	{
+		if (!bench_once(cmd, NULL))
+		{
+			printf("execvp() failed, command was not run\n");
+			return 0;
+		}
+	}
+
+	// samples[metric][run]
+	double* samples[NUM_BENCH_METRICS];
+	for (int m = 0; m < NUM_BENCH_METRICS; m++)
+	{
+		samples[m] = malloc(sizeof(double) * runs);
+	}
+
+	double sample[NUM_BENCH_METRICS];
+	for (int i = 0; i < runs; i++)
+	{
+		if (!bench_once(cmd, sample))
+		{
+			printf("execvp() failed, command was not run\n");
+			for (int m = 0; m < NUM_BENCH_METRICS; m++)
+			{
+				free(samples[m]);
+			}
+			return 0;
+		}
+
+		for (int m = 0; m < NUM_BENCH_METRICS; m++)
+		{
+			samples[m][i] = sample[m];
+		}
+	}
+
+	FILE* out = stdout;
+	if (out_path != NULL)
+	{
+		out = fopen(out_path, "w");
+		if (out == NULL)
+		{
+			printf("Could not open %s, writing to the terminal instead\n", out_path);
+			out = stdout;
+		}
+	}
+
+	// the raw samples go into the json output, copy them before summarize_samples() sorts them
+	double* raw = NULL;
+	if (format == BENCH_JSON)
+	{
+		raw = malloc(sizeof(double) * runs * NUM_BENCH_METRICS);
+		for (int m = 0; m < NUM_BENCH_METRICS; m++)
+		{
+			memcpy(&raw[m * runs], samples[m], sizeof(double) * runs);
+		}
+	}
+
+	if (format == BENCH_TEXT)
+	{
+		fprintf(out, "-->Benchmark Stats<-- (%d runs, %d warm-up)\n", runs, warmup);
+		fprintf(out, "%-30s %12s %12s %12s %12s %12s\n", "", "min", "median", "mean", "p95", "stddev");
+	}
+	else if (format == BENCH_CSV)
+	{
+		fprintf(out, "metric,unit,runs,min,median,mean,p95,stddev\n");
+	}
+	else
+	{
+		fprintf(out, "{\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"metrics\": {\n", runs, warmup);
+	}
+
+	for (int m = 0; m < NUM_BENCH_METRICS; m++)
+	{
+		BenchSummary sum = summarize_samples(samples[m], runs);
+
+		if (format == BENCH_TEXT)
+		{
+			double scale = is_time[m] ? 1e6 : 1;
+			char label[64];
+			snprintf(label, sizeof(label), "%s%s", names[m], is_time[m] ? " (ms)" : "");
+			fprintf(out, "%-30s %12.3f %12.3f %12.3f %12.3f %12.3f\n", label, sum.min / scale, sum.median / scale, sum.mean / scale, sum.p95 / scale, sum.stddev / scale);
+		}
+		else if (format == BENCH_CSV)
+		{
+			fprintf(out, "%s,%s,%d,%.0f,%.1f,%.1f,%.1f,%.1f\n", names[m], is_time[m] ? "ns" : "count", runs, sum.min, sum.median, sum.mean, sum.p95, sum.stddev);
+		}
+		else
+		{
+			fprintf(out, "    \"%s\": {\"unit\": \"%s\", \"min\": %.0f, \"median\": %.1f, \"mean\": %.1f, \"p95\": %.1f, \"stddev\": %.1f, \"samples\": [", names[m], is_time[m] ? "ns" : "count", sum.min, sum.median, sum.mean, sum.p95, sum.stddev);
+			for (int i = 0; i < runs; i++)
+			{
+				fprintf(out, "%s%.0f", i == 0 ? "" : ", ", raw[m * runs + i]);
+			}
+			fprintf(out, "]}%s\n", m == NUM_BENCH_METRICS - 1 ? "" : ",");
+		}
+	}
+
+	if (format == BENCH_JSON)
+	{
+		fprintf(out, "  }\n}\n");
+	}
+
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+
+	free(raw);
+	for (int m = 0; m < NUM_BENCH_METRICS; m++)
+	{
+		free(samples[m]);
+	}
+
+	return 1;
+}
+
+int bench_once(char** args, double* sample)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	fflush(stdout);
+
+	int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	// turning off auto reap so we can wait for the child, before it has a chance to exit
+	signal(SIGCHLD, SIG_DFL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	int pid = -1;
+	if (zygote_enabled && devnull != -1)
+	{
+		pid = zygote_launch(args, devnull, STDERR_FILENO, NULL);
+	}
+	bool from_zygote = pid != -1;
+
+	if (!from_zygote)
+	{
+		pid = fork();
+	}
+
+	if (pid < 0)
+	{
+		printf("Could not fork\n");
+		signal(SIGCHLD, SIG_IGN);
+		if (devnull != -1)
+		{
+			close(devnull);
+		}
+		return 0;
+	}
+	else if (pid == 0)
+	{
+		// child
+		if (devnull != -1)
+		{
+			dup2(devnull, STDOUT_FILENO);
+		}
+
+		execvp(args[0], args);
+		// the parent can't see anything printed here, the exit status tells it the command was not run
+		_exit(127);
+	}
+
+	int status;
+	int ret;
+	struct rusage usage;
+	do
+	{
+		ret = wait4(pid, &status, 0, &usage);
+	}
+	while (ret == -1 && errno == EINTR);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	// turning auto reap back on
+	signal(SIGCHLD, SIG_IGN);
+
+	if (devnull != -1)
+	{
+		close(devnull);
+	}
+
+	// outside of the timed part, so each run measures a launch from a full pool
+	if (from_zygote)
+	{
+		zygote_refill();
+	}
+
+	if (ret == -1 || (WIFEXITED(status) && WEXITSTATUS(status) == 127))
+	{
+		return 0;
+	}
+
+	if (sample != NULL)
+	{
+		sample[BENCH_WALL] = (double) (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		sample[BENCH_USER] = (double) usage.ru_utime.tv_sec * 1e9 + usage.ru_utime.tv_usec * 1e3;
+		sample[BENCH_SYSTEM] = (double) usage.ru_stime.tv_sec * 1e9 + usage.ru_stime.tv_usec * 1e3;
+		sample[BENCH_MINOR_FAULTS] = usage.ru_minflt;
+		sample[BENCH_MAJOR_FAULTS] = usage.ru_majflt;
+		sample[BENCH_VOLUNTARY_CS] = usage.ru_nvcsw;
+		sample[BENCH_INVOLUNTARY_CS] = usage.ru_nivcsw;
+	}
+
+	return 1;
+}
+
+int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+BenchSummary summarize_samples(double* samples, int num_samples)
+{
+	BenchSummary sum;
+
+	qsort(samples, num_samples, sizeof(double), compare_doubles);
+
+	sum.min = samples[0];
+
+	if (num_samples % 2 == 1)
+	{
+		sum.median = samples[num_samples / 2];
+	}
+	else
+	{
+		sum.median = (samples[num_samples / 2 - 1] + samples[num_samples / 2]) / 2;
+	}
+
+	// nearest rank
+	int rank = (int) ceil(0.95 * num_samples);
+	sum.p95 = samples[rank - 1];
+
+	double total = 0;
+	for (int i = 0; i < num_samples; i++)
+	{
+		total += samples[i];
+	}
+	sum.mean = total / num_samples;
+
+	// sample standard deviation, 0 when there is only one run
+	double squares = 0;
+	for (int i = 0; i < num_samples; i++)
+	{
+		squares += (samples[i] - sum.mean) * (samples[i] - sum.mean);
+	}
+	sum.stddev = num_samples > 1 ? sqrt(squares / (num_samples - 1)) : 0;
+
+	return sum;
+}
+
+int wait_and_sample(int pid, Job* job, int* status, int out_fd, int memfd)
+{
+	// with SIGCHLD blocked the grand child's exit stays pending, so sigtimedwait() below returns as soon as it happens
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	ProcSample prev;
+	ProcSample cur;
+	bool have_prev = false;
+
+	char buf[BATCH_READ_CHUNK];
+
+	// the first sample is taken straight away
+	struct timespec next_sample;
+	clock_gettime(CLOCK_MONOTONIC, &next_sample);
+
+	while (1)
+	{
+		// WNOWAIT leaves the grand child as a zombie, so its /proc entries can still be read for the final totals
+		siginfo_t info;
+		info.si_pid = 0;
+		if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long wait_ns = (next_sample.tv_sec - now.tv_sec) * 1000000000LL + (next_sample.tv_nsec - now.tv_nsec);
+
+		if (info.si_pid == pid || wait_ns <= 0)
+		{
+			if (read_proc_sample(pid, &cur))
+			{
+				update_job_sample(job, have_prev ? &prev : NULL, &cur);
+				prev = cur;
+				have_prev = true;
+			}
+
+			next_sample = now;
+			next_sample.tv_nsec += SAMPLE_INTERVAL_MS * 1000000L;
+			next_sample.tv_sec += next_sample.tv_nsec / 1000000000L;
+			next_sample.tv_nsec %= 1000000000L;
+			wait_ns = SAMPLE_INTERVAL_MS * 1000000LL;
+		}
+
+		if (info.si_pid == pid)
+		{
+			break;
+		}
+
+		if (out_fd != -1)
+		{
+			// reading the job's output until the next sample is due, the pipe closing usually means the job has exited
+			struct pollfd pfd;
+			pfd.fd = out_fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, wait_ns / 1000000 + 1) > 0)
+			{
+				ssize_t n = read(out_fd, buf, sizeof(buf));
+				if (n > 0)
+				{
+					capture_output(job, memfd, buf, n);
+				}
+				else if (n == 0 || errno != EINTR)
+				{
+					close(out_fd);
+					out_fd = -1;
+				}
+			}
+		}
+		else
+		{
+			struct timespec timeout;
+			timeout.tv_sec = wait_ns / 1000000000LL;
+			timeout.tv_nsec = wait_ns % 1000000000LL;
+			sigtimedwait(&set, NULL, &timeout);
+		}
+	}
+
+	// picking up whatever the job wrote just before exiting. anything it started in the background may still hold the pipe
+	// open, so this only takes what is already there instead of waiting for end of file
+	if (out_fd != -1)
+	{
+		struct pollfd pfd;
+		pfd.fd = out_fd;
+		pfd.events = POLLIN;
+		while (poll(&pfd, 1, 0) > 0)
+		{
+			ssize_t n = read(out_fd, buf, sizeof(buf));
+			if (n <= 0)
+			{
+				break;
+			}
+			capture_output(job, memfd, buf, n);
+		}
+		close(out_fd);
+	}
+
+	int ret;
+	do
+	{
+		ret = wait4(pid, status, 0, &job->usage);
+	}
+	while (ret == -1 && errno == EINTR);
+
+	// anything the command grew by after the last sample is only in the kernel's own high water mark
+	if (ret == pid && job->usage.ru_maxrss > job->peak_rss_kb)
+	{
+		job->peak_rss_kb = job->usage.ru_maxrss;
+	}
+
+	return ret;
+}
+
+int read_proc_sample(int pid, ProcSample* sample)
+{
+	static long ticks_per_sec = 0;
+	static long page_kb = 0;
+	if (ticks_per_sec == 0)
+	{
+		ticks_per_sec = sysconf(_SC_CLK_TCK);
+		page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	}
+
+	char path[64];
+	char buf[1024];
+
+	clock_gettime(CLOCK_MONOTONIC, &sample->when);
+
+	// stat: the command name is in parentheses and may contain spaces, so the fields are parsed from the last ')'
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		return 0;
+	}
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+	{
+		return 0;
+	}
+	buf[n] = '\0';
+
+	char* fields = strrchr(buf, ')');
+	unsigned long long utime;
+	unsigned long long stime;
+	long rss_pages;
+	// fields 3 to 24 of proc(5), we want utime (14), stime (15) and rss (24)
+	if (fields == NULL || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %ld", &utime, &stime, &rss_pages) != 3)
+	{
+		return 0;
+	}
+
+	sample->cpu_ms = (utime + stime) * 1000 / ticks_per_sec;
+	sample->rss_kb = rss_pages * page_kb;
+	sample->peak_rss_kb = sample->rss_kb;
+
+	// status: VmHWM is the peak rss, it is missing once the process is a zombie
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	FILE* f = fopen(path, "r");
+	if (f != NULL)
+	{
+		while (fgets(buf, sizeof(buf), f) != NULL)
+		{
+			long kb;
+			if (sscanf(buf, "VmHWM: %ld", &kb) == 1)
+			{
+				sample->peak_rss_kb = kb;
+				break;
+			}
+		}
+		fclose(f);
+	}
+
+	// io: only readable by the owner of the process
+	sample->read_bytes = -1;
+	sample->write_bytes = -1;
+	snprintf(path, sizeof(path), "/proc/%d/io", pid);
+	f = fopen(path, "r");
+	if (f != NULL)
+	{
+		while (fgets(buf, sizeof(buf), f) != NULL)
+		{
+			long long bytes;
+			if (sscanf(buf, "read_bytes: %lld", &bytes) == 1)
+			{
+				sample->read_bytes = bytes;
+			}
+			else if (sscanf(buf, "write_bytes: %lld", &bytes) == 1)
+			{
+				sample->write_bytes = bytes;
+			}
+		}
+		fclose(f);
+	}
+
+	return 1;
+}
+
+void update_job_sample(Job* job, ProcSample* prev, ProcSample* cur)
+{
+	// a zombie has no memory left, keep the last rss that was seen while it was running
+	if (cur->rss_kb > 0 || prev == NULL)
+	{
+		job->rss_kb = cur->rss_kb;
+	}
+
+	if (cur->peak_rss_kb > job->peak_rss_kb)
+	{
+		job->peak_rss_kb = cur->peak_rss_kb;
+	}
+
+	if (cur->read_bytes != -1)
+	{
+		job->read_bytes = cur->read_bytes;
+		job->write_bytes = cur->write_bytes;
+	}
+
+	if (prev == NULL)
+	{
+		job->cpu_percent = 0;
+		job->read_rate = cur->read_bytes == -1 ? -1 : 0;
+		job->write_rate = cur->write_bytes == -1 ? -1 : 0;
+		return;
+	}
+
+	double dt = (cur->when.tv_sec - prev->when.tv_sec) + (cur->when.tv_nsec - prev->when.tv_nsec) / 1e9;
+	if (dt <= 0)
+	{
+		return;
+	}
+
+	job->cpu_percent = (cur->cpu_ms - prev->cpu_ms) / 10.0 / dt;
+
+	if (cur->read_bytes != -1 && prev->read_bytes != -1)
+	{
+		job->read_rate = (cur->read_bytes - prev->read_bytes) / dt;
+		job->write_rate = (cur->write_bytes - prev->write_bytes) / dt;
+	}
+
+	// when the series is full, merge every pair of points so it covers twice the time per point
+	if (job->series_len == SERIES_LEN)
+	{
+		for (int i = 0; i < SERIES_LEN / 2; i++)
+		{
+			long a = job->rss_series[2 * i];
+			long b = job->rss_series[2 * i + 1];
+			job->rss_series[i] = a > b ? a : b;
+			job->cpu_series[i] = (job->cpu_series[2 * i] + job->cpu_series[2 * i + 1]) / 2;
+		}
+		job->series_len = SERIES_LEN / 2;
+		job->series_interval_ms *= 2;
+	}
+
+	// points are only added once a full interval of samples has gone by since the last one
+	job->pending_samples++;
+	job->pending_cpu += job->cpu_percent;
+	if (job->rss_kb > job->pending_rss)
+	{
+		job->pending_rss = job->rss_kb;
+	}
+
+	if (job->pending_samples * SAMPLE_INTERVAL_MS >= job->series_interval_ms)
+	{
+		job->rss_series[job->series_len] = job->pending_rss;
+		job->cpu_series[job->series_len] = job->pending_cpu / job->pending_samples;
+		job->series_len++;
+		job->pending_samples = 0;
+		job->pending_cpu = 0;
+		job->pending_rss = 0;
+	}
+}
+
+void print_job_samples(Job* job)
+{
+	printf("Peak Resident Set Size: %ldKB\n", job->peak_rss_kb);
+
+	if (job->read_bytes == -1)
+	{
+		printf("Bytes Read/Written: not available\n");
+	}
+	else
+	{
+		printf("Bytes Read: %lld\n", job->read_bytes);
+		printf("Bytes Written: %lld\n", job->write_bytes);
+	}
+
+	if (job->series_len > 0)
+	{
+		printf("RSS Over Time (KB, every %dms):", job->series_interval_ms);
+		for (int i = 0; i < job->series_len; i++)
+		{
+			printf(" %ld", job->rss_series[i]);
+		}
+		printf("\n");
+
+		printf("CPU Over Time (%%, every %dms):", job->series_interval_ms);
+		for (int i = 0; i < job->series_len; i++)
+		{
+			printf(" %.0f", job->cpu_series[i]);
+		}
+		printf("\n");
+	}
+}
+
+void zygote_refill(void)
+{
+	while (zygote_pool_len < ZYGOTE_POOL_SIZE)
+	{
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+		{
+			printf("Could not create socket for zygote helper\n");
+			return;
+		}
+
+		fflush(stdout);
+
+		int pid = fork();
+
+		if (pid < 0)
+		{
+			printf("Could not fork\n");
+			close(sv[0]);
+			close(sv[1]);
+			return;
+		}
+		else if (pid == 0)
+		{
+			// helper, everything but stdin/stdout/stderr and its own socket is closed. otherwise it would hold the other
+			// helpers' sockets and any batch command's pipe open, and they would never see end of file
+			close_range(3, sv[1] - 1, 0);
+			close_range(sv[1] + 1, ~0U, 0);
+			zygote_helper(sv[1]);
+		}
+
+		close(sv[1]);
+		zygote_pids[zygote_pool_len] = pid;
+		zygote_socks[zygote_pool_len] = sv[0];
+		zygote_pool_len++;
+	}
+}
+
+int zygote_launch(char** args, int out_fd, int err_fd, PerfCounters* perf)
+{
+	if (zygote_pool_len == 0)
+	{
+		// only happens for the first command after zygote mode is turned on
+		zygote_refill();
+		if (zygote_pool_len == 0)
+		{
+			return -1;
+		}
+	}
+
+	zygote_pool_len--;
+	int pid = zygote_pids[zygote_pool_len];
+	int sock = zygote_socks[zygote_pool_len];
+
+	// the message is the working directory, the number of arguments, the arguments and then the environment, all as
+	// strings each followed by a '\0'
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		cwd[0] = '\0';
+	}
+
+	int argc;
+	for (argc = 0; args[argc] != NULL; argc++) {}
+
+	char argc_str[16];
+	snprintf(argc_str, sizeof(argc_str), "%d", argc);
+
+	size_t len = strlen(cwd) + 1 + strlen(argc_str) + 1;
+	for (int i = 0; i < argc; i++)
+	{
+		len += strlen(args[i]) + 1;
+	}
+	for (int i = 0; environ[i] != NULL; i++)
+	{
+		len += strlen(environ[i]) + 1;
+	}
+
+	char* payload = malloc(len);
+	char* p = payload;
+	p = stpcpy(p, cwd) + 1;
+	p = stpcpy(p, argc_str) + 1;
+	for (int i = 0; i < argc; i++)
+	{
+		p = stpcpy(p, args[i]) + 1;
+	}
+	for (int i = 0; environ[i] != NULL; i++)
+	{
+		p = stpcpy(p, environ[i]) + 1;
+	}
+
+	if (perf != NULL)
+	{
+		attach_perf_counters(pid, NULL, perf);
+	}
+
+	// the length goes first, with the stdout and stderr file descriptors attached to it
+	uint32_t header = len;
+	struct iovec iov;
+	iov.iov_base = &header;
+	iov.iov_len = sizeof(header);
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct msghdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control.buf;
+	hdr.msg_controllen = sizeof(control.buf);
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 2);
+	int fds[2] = {out_fd, err_fd};
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	bool sent = sendmsg(sock, &hdr, MSG_NOSIGNAL) == sizeof(header);
+	for (size_t off = 0; sent && off < len; )
+	{
+		ssize_t n = send(sock, payload + off, len - off, MSG_NOSIGNAL);
+		if (n == -1 && errno != EINTR)
+		{
+			sent = false;
+		}
+		else if (n > 0)
+		{
+			off += n;
+		}
+	}
+
+	free(payload);
+	close(sock);
+
+	if (!sent)
+	{
+		// the helper is gone, it has already been (or will be) reaped so the caller just forks instead
+		printf("Could not hand command to zygote helper [%d]\n", pid);
+		if (perf != NULL)
+		{
+			collect_perf_counters(perf);
+		}
+		return -1;
+	}
+
+	return pid;
+}
+
+void zygote_helper(int sock)
+{
+	uint32_t len;
+	struct iovec iov;
+	iov.iov_base = &len;
+	iov.iov_len = sizeof(len);
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+		struct cmsghdr align;
+	} control;
+
+	struct msghdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control.buf;
+	hdr.msg_controllen = sizeof(control.buf);
+
+	ssize_t n;
+	do
+	{
+		n = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+	}
+	while (n == -1 && errno == EINTR);
+
+	// end of file means doit closed the pool
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+	if (n != sizeof(len) || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+	{
+		_exit(0);
+	}
+
+	int fds[2];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	char* payload = malloc(len);
+	for (size_t off = 0; off < len; )
+	{
+		n = read(sock, payload + off, len - off);
+		if (n == 0 || (n == -1 && errno != EINTR))
+		{
+			_exit(0);
+		}
+		if (n > 0)
+		{
+			off += n;
+		}
+	}
+	close(sock);
+
+	// unpacking the message, see zygote_launch()
+	char* end = payload + len;
+	char* cwd = payload;
+	char* p = cwd + strlen(cwd) + 1;
+	int argc = atoi(p);
+	p += strlen(p) + 1;
+
+	char** args = malloc(sizeof(char*) * (argc + 1));
+	for (int i = 0; i < argc; i++)
+	{
+		args[i] = p;
+		p += strlen(p) + 1;
+	}
+	args[argc] = NULL;
+
+	int envc = 0;
+	for (char* q = p; q < end; q += strlen(q) + 1)
+	{
+		envc++;
+	}
+	char** env = malloc(sizeof(char*) * (envc + 1));
+	for (int i = 0; i < envc; i++)
+	{
+		env[i] = p;
+		p += strlen(p) + 1;
+	}
+	env[envc] = NULL;
+
+	if (cwd[0] != '\0' && chdir(cwd) == -1)
+	{
+		printf("Could not change directory to %s\n", cwd);
+	}
+
+	dup2(fds[0], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+
+	// the helper was forked from the shell, whose SIGCHLD is set to be ignored
+	signal(SIGCHLD, SIG_DFL);
+
+	execvpe(args[0], args, env);
+	printf("execvp() failed, command was not run\n");
+	// 127 like a shell, so bench_once() can tell the command was not run
+	exit(127);
+}
+
+void zygote_shutdown(void)
+{
+	for (int i = 0; i < zygote_pool_len; i++)
+	{
+		close(zygote_socks[i]);
+	}
+
+	zygote_pool_len = 0;
+}
+
+void capture_output(Job* job, int memfd, char* buf, size_t len)
+{
+	long long memory_len = atomic_load(&job->memory_len);
+
+	if (memory_len < CAPTURE_MEMORY_LIMIT)
+	{
+		size_t n = len;
+		if (memory_len + (long long) n > CAPTURE_MEMORY_LIMIT)
+		{
+			n = CAPTURE_MEMORY_LIMIT - memory_len;
+		}
+
+		ssize_t written = pwrite(memfd, buf, n, memory_len);
+		if (written <= 0)
+		{
+			return;
+		}
+
+		// the shell only reads up to memory_len, so the bytes have to be written before it is raised
+		atomic_store_explicit(&job->memory_len, memory_len + written, memory_order_release);
+		buf += written;
+		len -= written;
+	}
+
+	if (len == 0)
+	{
+		return;
+	}
+
+	if (job->spill_path[0] == '\0')
+	{
+		char path[sizeof(job->spill_path)] = "/tmp/doit-job-XXXXXX";
+		int fd = mkstemp(path);
+		if (fd == -1)
+		{
+			return;
+		}
+		close(fd);
+		strcpy(job->spill_path, path);
+	}
+
+	int fd = open(job->spill_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+
+	ssize_t written = write(fd, buf, len);
+	close(fd);
+
+	if (written > 0)
+	{
+		atomic_fetch_add_explicit(&job->spill_len, written, memory_order_release);
+	}
+}
+
+void print_captured(int slot, int lines)
+{
+	Job* job = &arena->jobs[slot];
+	int memfd = capture_fds[slot];
+
+	long long memory_len = atomic_load_explicit(&job->memory_len, memory_order_acquire);
+	long long spill_len = atomic_load_explicit(&job->spill_len, memory_order_acquire);
+
+	int spill_fd = -1;
+	if (spill_len > 0)
+	{
+		spill_fd = open(job->spill_path, O_RDONLY | O_CLOEXEC);
+		if (spill_fd == -1)
+		{
+			spill_len = 0;
+		}
+	}
+
+	long long total = memory_len + spill_len;
+	long long start = 0;
+
+	// for tail, only the last TAIL_WINDOW bytes are searched for the start of the last lines
+	char* window = NULL;
+	if (lines != -1)
+	{
+		start = total > TAIL_WINDOW ? total - TAIL_WINDOW : 0;
+		window = malloc(total - start);
+	}
+
+	char buf[BATCH_READ_CHUNK];
+
+	fflush(stdout);
+
+	// the output is the memfd followed by the spill file
+	for (long long pos = start; pos < total; )
+	{
+		ssize_t n;
+		size_t want = total - pos < (long long) sizeof(buf) ? (size_t) (total - pos) : sizeof(buf);
+		if (pos < memory_len)
+		{
+			if ((long long) want > memory_len - pos)
+			{
+				want = memory_len - pos;
+			}
+			n = pread(memfd, buf, want, pos);
+		}
+		else
+		{
+			n = pread(spill_fd, buf, want, pos - memory_len);
+		}
+
+		if (n <= 0)
+		{
+			total = pos;
+			break;
+		}
+
+		if (window != NULL)
+		{
+			memcpy(window + (pos - start), buf, n);
+		}
+		else
+		{
+			fwrite(buf, 1, n, stdout);
+		}
+		pos += n;
+	}
+
+	if (window != NULL)
+	{
+		long long len = total - start;
+
+		// a final newline does not start another line
+		long long i = len;
+		if (i > 0 && window[i - 1] == '\n')
+		{
+			i--;
+		}
+
+		int found = 0;
+		while (i > 0)
+		{
+			if (window[i - 1] == '\n' && ++found == lines)
+			{
+				break;
+			}
+			i--;
+		}
+
+		fwrite(window + i, 1, len - i, stdout);
+		free(window);
+	}
+
+	if (total > 0 && lines == -1)
+	{
+		printf("-->End Of Output (%lld bytes%s)<--\n", total, spill_len > 0 ? ", spilled to disk" : "");
+	}
+
+	if (spill_fd != -1)
+	{
+		close(spill_fd);
+	}
+
+	fflush(stdout);
+}
+
+void release_capture(int slot)
+{
+	if (capture_fds[slot] != -1)
+	{
+		close(capture_fds[slot]);
+		capture_fds[slot] = -1;
+	}
+
+	if (arena->jobs[slot].spill_path[0] != '\0')
+	{
+		unlink(arena->jobs[slot].spill_path);
+		arena->jobs[slot].spill_path[0] = '\0';
 	}
 }
@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+# usage: ./stress.sh [num_jobs] [seconds_per_job]
+# starts num_jobs background jobs through doit all at once and checks that every one of them is reported as completed
+
+jobs=${1:-2000}
+seconds=${2:-10}
+doit=${DOIT:-./doit}
+
+if [[ ! -x $doit ]]; then
+    echo "Could not find $doit, build it with run.sh first" >&2
+    exit 1
+fi
+
+start=$(date +%s.%N)
+
+out=$(
+    {
+        for ((i = 0; i < jobs; i++)); do
+            echo "sleep $seconds &"
+        done
+        echo "jobs"
+        echo "exit"
+    } | "$doit"
+)
+
+end=$(date +%s.%N)
+
+started=$(grep -c '^\(==>\)*\[[0-9]*\] [0-9]*$' <<< "$out")
+listed=$(grep -c ' sleep CPU: ' <<< "$out")
+completed=$(grep -c '^\(==>\)*\[[0-9]*\] [0-9]* Completed$' <<< "$out")
+errors=$(grep -c 'Could not' <<< "$out")
+
+echo "Jobs started: $started"
+echo "Jobs listed by the jobs builtin: $listed"
+echo "Jobs completed: $completed"
+echo "Errors: $errors"
+awk -v s="$start" -v e="$end" 'BEGIN { printf "Total time: %.2fs\n", e - s }'
+
+if [[ $started -ne $jobs || $completed -ne $jobs || $errors -ne 0 ]]; then
+    echo "FAILED" >&2
+    exit 1
+fi
+echo "PASSED"
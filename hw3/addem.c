@@ -40,7 +40,14 @@ int main(int argc, char* argv[])
 	int amount_for_each = (val - leftover) / num_threads;
 	int where_are_we = 1;
 
-	init_boxes(num_threads + 1);
+	// box 0 has room for every worker's total
+	int capacities[num_threads + 1];
+	capacities[0] = num_threads;
+	for (int i = 1; i <= num_threads; i++)
+	{
+		capacities[i] = 1;
+	}
+	init_boxes(num_threads + 1, capacities);
 
 	msg msg;
 	msg.iSender = 0;
@@ -71,14 +78,21 @@ int main(int argc, char* argv[])
 
 	int total = 0;
 
-	for (int i = 0; i < num_threads; i++)
+	// the totals are taken as they come, every one already waiting in one go
+	struct msg totals[num_threads];
+	int received = 0;
+	while (received < num_threads)
 	{
-		RecvMsg(0, &msg);
-		if (msg.type == ALLDONE)
+		int n = RecvMsgBatch(0, totals, num_threads - received);
+		for (int i = 0; i < n; i++)
 		{
-			total += msg.value1;
-			pthread_join(threads[msg.iSender - 1], NULL);
+			if (totals[i].type == ALLDONE)
+			{
+				total += totals[i].value1;
+				pthread_join(threads[totals[i].iSender - 1], NULL);
+			}
 		}
+		received += n;
 	}
 
 	printf("The total for 1 to %d using %d threads is %d.\n", val, num_threads, total);
@@ -0,0 +1,54 @@
+#include <sched.h>
+#include <unistd.h>
+#include "barrier.h"
+
+// how many times a waiting thread checks the sense before yielding, when there is a cpu for every thread
+#define SPIN_LIMIT 1000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
+
+void init_barrier(barrier* b, int parties)
+{
+	atomic_init(&b->remaining, parties);
+	atomic_init(&b->sense, false);
+	b->parties = parties;
+
+	// with more threads than cpus, the thread being waited for is usually not running, so spinning only delays it
+	b->spin_limit = parties <= sysconf(_SC_NPROCESSORS_ONLN) ? SPIN_LIMIT : 0;
+}
+
+bool barrier_wait(barrier* b, bool* local_sense, void (*last)(void* arg), void* arg)
+{
+	*local_sense = !*local_sense;
+
+	if (atomic_fetch_sub_explicit(&b->remaining, 1, memory_order_acq_rel) == 1)
+	{
+		if (last != NULL)
+		{
+			last(arg);
+		}
+
+		atomic_store_explicit(&b->remaining, b->parties, memory_order_relaxed);
+		atomic_store_explicit(&b->sense, *local_sense, memory_order_release);
+		return true;
+	}
+
+	int spins = 0;
+	while (atomic_load_explicit(&b->sense, memory_order_acquire) != *local_sense)
+	{
+		if (spins++ < b->spin_limit)
+		{
+			cpu_relax();
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	return false;
+}
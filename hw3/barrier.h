@@ -0,0 +1,36 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * a sense-reversing barrier. each thread keeps its own sense, flips it on arrival and spins until the barrier's shared
+ * sense matches. the last thread to arrive resets the count and flips the shared sense, releasing everyone at once, so the
+ * barrier can be reused immediately without a second phase
+*/
+typedef struct barrier
+{
+	_Atomic int remaining;
+	_Atomic bool sense;
+	int parties;
+
+	// how many times a waiting thread checks the sense before it starts yielding its cpu between checks
+	int spin_limit;
+} barrier;
+
+void init_barrier(barrier* b, int parties);
+
+/*
+ * blocks until all parties have arrived
+ * params
+ * b: the barrier
+ * local_sense: the calling thread's sense, starts out false and is only touched by this function
+ * last: called by the last thread to arrive, before anyone is released. may be NULL
+ * arg: passed to last
+ * returns
+ * true in the thread that ran last
+*/
+bool barrier_wait(barrier* b, bool* local_sense, void (*last)(void* arg), void* arg);
+
+#endif
@@ -0,0 +1,95 @@
+#!/usr/bin/env bash
+# usage: ./bench.sh > results.csv
+# runs life over generated boards, an R-pentomino, a Gosper glider gun and a 50% random soup at every size, with every
+# kernel and thread count, and prints one CSV line per run. the boards are generated once with lifegen and kept in
+# $BOARDS. everything can be narrowed down with these, each a space separated list or a number:
+#   SIZES        board sizes, the boards are square (default 64 256 1024 4096 16384)
+#   PATTERNS     rpentomino, gun and/or random (default all three)
+#   KERNELS      packed and/or simple (default both)
+#   THREADS      thread counts (default 1, 2, 4, ... up to the number of cores)
+#   CELLS        cell updates each packed run aims for, which sets its number of generations (default 2^30)
+#   SIMPLE_MAX   the largest size the simple kernel is run at, it is around a hundred times slower (default 4096)
+#   SYNC         mailbox or barrier (default barrier)
+# efficiency is cells per second over what the first thread count managed, scaled by the threads, so it is 1 for perfect
+# scaling
+
+if [[ $# -ne 0 ]]; then
+    echo "Usage: $0 > results.csv" >&2
+    exit 1
+fi
+
+life=${LIFE:-./life}
+lifegen=${LIFEGEN:-./lifegen}
+boards=${BOARDS:-bench-boards}
+sizes=${SIZES:-64 256 1024 4096 16384}
+patterns=${PATTERNS:-rpentomino gun random}
+kernels=${KERNELS:-packed simple}
+cells=${CELLS:-1073741824}
+simple_max=${SIMPLE_MAX:-4096}
+sync=${SYNC:-barrier}
+
+if [[ -z $THREADS ]]; then
+    for ((t = 1; t < $(nproc); t *= 2)); do
+        THREADS+="$t "
+    done
+    THREADS+=$(nproc)
+fi
+
+for exe in "$life" "$lifegen"; do
+    if [[ ! -x $exe ]]; then
+        echo "Could not find $exe, build it with make first" >&2
+        exit 1
+    fi
+done
+
+mkdir -p "$boards" || exit 1
+
+echo "pattern,size,kernel,threads,generations,sim_ms,cells_per_s,p50_us,p90_us,p99_us,speedup,efficiency"
+
+for pattern in $patterns; do
+    for size in $sizes; do
+        board=$boards/$pattern-$size.rle
+        if [[ ! -f $board ]] && ! "$lifegen" "$pattern" "$size" "$board" > /dev/null; then
+            echo "Could not generate $board" >&2
+            continue
+        fi
+
+        for kernel in $kernels; do
+            if [[ $kernel == simple && $size -gt $simple_max ]]; then
+                continue
+            fi
+
+            # about the same work at every size, between 10 and 1000 generations
+            budget=$cells
+            if [[ $kernel == simple ]]; then
+                budget=$((cells / 128))
+            fi
+            generations=$((budget / size / size))
+            generations=$((generations < 10 ? 10 : generations > 1000 ? 1000 : generations))
+
+            base_rate=
+            base_threads=
+            for threads in $THREADS; do
+                # -q leaves out the final board, which at 16384 is over half a gigabyte, so only the stats come out
+                stats=$("$life" -q -s -m "$sync" -k "$kernel" "$threads" "$board" "$generations" n |
+                    sed -n '/^-->Run Stats<--$/,$p')
+                ms=$(awk -F': |ms' '/^Simulation Time/ {print $2}' <<< "$stats")
+                computed=$(awk -F': ' '/^Generations Computed/ {print $2}' <<< "$stats")
+                latency=$(sed -En 's/^Generation Latency: p50 (.*)us, p90 (.*)us, p99 (.*)us$/\1,\2,\3/p' <<< "$stats")
+
+                if [[ -z $ms || -z $computed ]]; then
+                    echo "life failed on $board with $threads threads and the $kernel kernel" >&2
+                    continue
+                fi
+
+                rate=$(awk -v s="$size" -v g="$computed" -v ms="$ms" 'BEGIN { printf "%.0f", s * s * g / (ms / 1000) }')
+                base_rate=${base_rate:-$rate}
+                base_threads=${base_threads:-$threads}
+
+                awk -v p="$pattern" -v s="$size" -v k="$kernel" -v t="$threads" -v g="$computed" -v ms="$ms" -v r="$rate" \
+                    -v l="$latency" -v br="$base_rate" -v bt="$base_threads" \
+                    'BEGIN { printf "%s,%d,%s,%d,%d,%.3f,%.4g,%s,%.3f,%.3f\n", p, s, k, t, g, ms, r, l, r / br, r / br * bt / t }'
+            done
+        done
+    done
+done
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC "LIFECKPT"
+#define CHECKPOINT_VERSION 2
+
+// where the board starts, a page in so it can be mapped on its own
+#define CELLS_OFFSET 4096
+
+static int write_all(int fd, const void* data, size_t len)
+{
+	const char* p = data;
+	while (len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n <= 0)
+		{
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int save_checkpoint(const char* path, grid* g, checkpoint* c)
+{
+	memcpy(c->magic, CHECKPOINT_MAGIC, sizeof(c->magic));
+	c->version = CHECKPOINT_VERSION;
+	c->rows = g->rows;
+	c->cols = g->cols;
+	c->stride = g->stride;
+
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		printf("Could not write checkpoint %s.\n", tmp);
+		return -1;
+	}
+
+	char header[CELLS_OFFSET] = {0};
+	memcpy(header, c, sizeof(checkpoint));
+
+	int ret = write_all(fd, header, sizeof(header));
+	if (ret == 0)
+	{
+		ret = write_all(fd, g->cells, (size_t) (g->rows + 2) * g->stride * sizeof(uint64_t));
+	}
+	if (ret == 0)
+	{
+		ret = fsync(fd);
+	}
+	close(fd);
+
+	if (ret != 0 || rename(tmp, path) != 0)
+	{
+		printf("Could not write checkpoint %s.\n", path);
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int load_checkpoint(const char* path, grid* g, checkpoint* c)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		printf("Could not open checkpoint %s.\n", path);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < CELLS_OFFSET)
+	{
+		printf("Checkpoint %s is too short.\n", path);
+		close(fd);
+		return -1;
+	}
+
+	char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		printf("Could not map checkpoint %s.\n", path);
+		return -1;
+	}
+
+	memcpy(c, data, sizeof(checkpoint));
+
+	int ret = 0;
+	if (memcmp(c->magic, CHECKPOINT_MAGIC, sizeof(c->magic)) || c->version != CHECKPOINT_VERSION)
+	{
+		printf("%s is not a checkpoint, or is from another version of life.\n", path);
+		ret = -1;
+	}
+	else if (c->border < BORDER_DEAD || c->border > BORDER_TORUS || c->history_from < -1 || c->history_from > c->generation)
+	{
+		printf("Checkpoint %s has a border mode or cycle history life does not know.\n", path);
+		ret = -1;
+	}
+	else if (c->rows <= 0 || c->cols <= 0 || c->generation < 0 || init_grid(g, c->rows, c->cols) != 0)
+	{
+		printf("Could not allocate the grid for checkpoint %s.\n", path);
+		ret = -1;
+	}
+	else
+	{
+		size_t size = (size_t) (g->rows + 2) * g->stride * sizeof(uint64_t);
+
+		if (g->stride != c->stride || (size_t) st.st_size != CELLS_OFFSET + size)
+		{
+			printf("Checkpoint %s does not match its header.\n", path);
+			free_grid(g);
+			ret = -1;
+		}
+		else
+		{
+			memcpy(g->cells, data + CELLS_OFFSET, size);
+		}
+	}
+
+	munmap(data, st.st_size);
+
+	return ret;
+}
@@ -0,0 +1,62 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "grid.h"
+#include "rule.h"
+
+// how many generations of hashes -c keeps, and so how many a checkpoint carries
+#define CYCLE_HISTORY 64
+
+/*
+ * the header of a checkpoint file. it takes up the file's first page and the board follows, laid out word for word as
+ * the grid is in memory, ghost rows and padding included, so loading it is an mmap and one copy with no parsing. numbers
+ * are stored in the machine's own byte order, checkpoints are for restarting on the same machine
+*/
+typedef struct checkpoint
+{
+	char magic[8];
+	int version;
+
+	int rows;
+	int cols;
+	int stride;
+
+	// the generation the board is
+	long long generation;
+
+	rule life_rule;
+
+	// the border mode, BORDER_DEAD, BORDER_ALIVE or BORDER_TORUS
+	int border;
+
+	// the hash of generation n is in history[n % CYCLE_HISTORY] for n from history_from up to generation, or history_from is
+	// -1 if the run that wrote it was not hashing generations
+	long long history_from;
+	uint64_t history[CYCLE_HISTORY];
+} checkpoint;
+
+/*
+ * writes a checkpoint. it is written to <path>.tmp, synced and renamed over path, so path always holds a whole checkpoint
+ * even if the program dies partway through
+ * params
+ * path: the checkpoint file
+ * g: the board
+ * c: the rest of the state, magic, version and size are filled in here
+ * returns
+ * 0 on success, -1 after printing what went wrong
+*/
+int save_checkpoint(const char* path, grid* g, checkpoint* c);
+
+/*
+ * reads a checkpoint
+ * params
+ * path: the checkpoint file
+ * g: set up with init_grid() to the board's size and filled in
+ * c: set to the checkpoint's header
+ * returns
+ * 0 on success, -1 after printing what went wrong
+*/
+int load_checkpoint(const char* path, grid* g, checkpoint* c);
+
+#endif
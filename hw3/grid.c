@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+
+int init_grid(grid* g, int rows, int cols)
+{
+	g->rows = rows;
+	g->cols = cols;
+	g->words = (cols + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+
+	// rounded up to whole cache lines so no two rows share one, threads writing neighbouring rows do not contend
+	g->stride = (g->words + 2 + WORDS_PER_CACHE_LINE - 1) / WORDS_PER_CACHE_LINE * WORDS_PER_CACHE_LINE;
+
+	if (cols % CELLS_PER_WORD == 0)
+	{
+		g->last_mask = ~(uint64_t) 0;
+	}
+	else
+	{
+		g->last_mask = ((uint64_t) 1 << (cols % CELLS_PER_WORD)) - 1;
+	}
+
+	size_t size = (size_t) (rows + 2) * g->stride * sizeof(uint64_t);
+	g->cells = aligned_alloc(CACHE_LINE_SIZE, size);
+
+	if (g->cells == NULL)
+	{
+		return -1;
+	}
+
+	// the ghost rows and words are never written, so they stay 0
+	memset(g->cells, 0, size);
+
+	return 0;
+}
+
+void free_grid(grid* g)
+{
+	free(g->cells);
+	g->cells = NULL;
+}
+
+/*
+ * computes word w of the next generation of row from the rows above and below it. bit i of the result is cell
+ * w * 64 + i
+*/
+static inline uint64_t next_word(uint64_t* above, uint64_t* row, uint64_t* below, int w)
+{
+	uint64_t a = above[w];
+	uint64_t c = row[w];
+	uint64_t b = below[w];
+
+	// shifted so that bit i holds the neighbour to the west or east of cell i, taking the edge cell from the next word
+	uint64_t a_west = (a << 1) | (above[w - 1] >> 63);
+	uint64_t a_east = (a >> 1) | (above[w + 1] << 63);
+	uint64_t c_west = (c << 1) | (row[w - 1] >> 63);
+	uint64_t c_east = (c >> 1) | (row[w + 1] << 63);
+	uint64_t b_west = (b << 1) | (below[w - 1] >> 63);
+	uint64_t b_east = (b >> 1) | (below[w + 1] << 63);
+
+	return next_cells(a_west, a, a_east, c_west, c, c_east, b_west, b, b_east);
+}
+
+void step_packed(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, bool* same_as_last,
+	bool* all_dead)
+{
+	uint64_t alive = 0;
+	uint64_t changed = 0;
+
+	// the last word of a row is done on its own so only it has to be masked
+	int last = prev->words - 1;
+	bool has_last = end_word > last;
+	int full_end = has_last ? last : end_word;
+
+	for (int i = start_row; i < end_row; i++)
+	{
+		uint64_t* above = grid_row(prev, i - 1);
+		uint64_t* row = grid_row(prev, i);
+		uint64_t* below = grid_row(prev, i + 1);
+		uint64_t* out = grid_row(next, i);
+
+		for (int w = start_word; w < full_end; w++)
+		{
+			uint64_t n = next_word(above, row, below, w);
+			out[w] = n;
+			alive |= n;
+			changed |= n ^ row[w];
+		}
+
+		if (has_last)
+		{
+			// the bits past the last cell can hold the border's ghost column
+			uint64_t n = next_word(above, row, below, last) & prev->last_mask;
+			out[last] = n;
+			alive |= n;
+			changed |= (n ^ row[last]) & prev->last_mask;
+		}
+	}
+
+	*same_as_last = changed == 0;
+	*all_dead = alive == 0;
+}
+
+/*
+ * get_cell() that also reads the ghost columns either side of the board, col -1 and col cols
+*/
+static inline bool get_ghost_cell(grid* g, int row, int col)
+{
+	int c = col + CELLS_PER_WORD;
+	return (grid_row(g, row)[c / CELLS_PER_WORD - 1] >> (c % CELLS_PER_WORD)) & 1;
+}
+
+void step_simple(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, bool* same_as_last,
+	bool* all_dead)
+{
+	*same_as_last = true;
+	*all_dead = true;
+
+	int start_col = start_word * CELLS_PER_WORD;
+	int end_col = end_word * CELLS_PER_WORD < prev->cols ? end_word * CELLS_PER_WORD : prev->cols;
+
+	for (int i = start_row; i < end_row; i++)
+	{
+		for (int j = start_col; j < end_col; j++)
+		{
+			// the cells just past the edges are the ghost cells, so there is nothing to clamp
+			int num_adj = 0;
+			for (int y = i - 1; y <= i + 1; y++)
+			{
+				for (int x = j - 1; x <= j + 1; x++)
+				{
+					num_adj += get_ghost_cell(prev, y, x);
+				}
+			}
+
+			bool was_alive = get_cell(prev, i, j);
+			num_adj -= was_alive;
+			bool alive = num_adj == 3 || (was_alive && num_adj == 2);
+			set_cell(next, i, j, alive);
+
+			if (alive)
+			{
+				*all_dead = false;
+			}
+			if (alive != was_alive)
+			{
+				*same_as_last = false;
+			}
+		}
+	}
+}
+
+step_func find_kernel(const char* name)
+{
+	if (!strcmp(name, "packed"))
+	{
+		return step_packed;
+	}
+	else if (!strcmp(name, "simple"))
+	{
+		return step_simple;
+	}
+
+	return NULL;
+}
+
+uint64_t hash_rect(grid* g, int start_row, int end_row, int start_word, int end_word)
+{
+	uint64_t hash = 0;
+
+	for (int i = start_row; i < end_row; i++)
+	{
+		uint64_t* row = grid_row(g, i);
+		for (int w = start_word; w < end_word; w++)
+		{
+			// the last word's padding can hold a ghost cell, which is not part of the board
+			uint64_t word = w == g->words - 1 ? row[w] & g->last_mask : row[w];
+
+			// empty words add nothing, which keeps sparse boards cheap
+			if (word == 0)
+			{
+				continue;
+			}
+
+			// splitmix64's finalizer over the word and where it is
+			uint64_t h = word + ((uint64_t) i * g->words + w + 1) * 0x9E3779B97F4A7C15ULL;
+			h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+			hash += h ^ (h >> 31);
+		}
+	}
+
+	return hash;
+}
+
+void fill_border(grid* g, int mode)
+{
+	if (mode == BORDER_DEAD)
+	{
+		return;
+	}
+
+	// the ghost column east of the board is cell cols, either a padding bit of the last word or bit 0 of the ghost word
+	int east_word = g->cols / CELLS_PER_WORD;
+	uint64_t east_bit = (uint64_t) 1 << (g->cols % CELLS_PER_WORD);
+
+	for (int i = 0; i < g->rows; i++)
+	{
+		uint64_t* row = grid_row(g, i);
+
+		uint64_t west = mode == BORDER_TORUS ? get_cell(g, i, g->cols - 1) : 1;
+		uint64_t east = mode == BORDER_TORUS ? get_cell(g, i, 0) : 1;
+
+		row[-1] = west << (CELLS_PER_WORD - 1);
+		row[east_word] = (row[east_word] & ~east_bit) | (east ? east_bit : 0);
+	}
+
+	// whole rows, ghost words included, so the corners come out right too
+	size_t row_size = (g->words + 2) * sizeof(uint64_t);
+	if (mode == BORDER_TORUS)
+	{
+		memcpy(grid_row(g, -1) - 1, grid_row(g, g->rows - 1) - 1, row_size);
+		memcpy(grid_row(g, g->rows) - 1, grid_row(g, 0) - 1, row_size);
+	}
+	else
+	{
+		memset(grid_row(g, -1) - 1, 0xFF, row_size);
+		memset(grid_row(g, g->rows) - 1, 0xFF, row_size);
+	}
+}
+
+int find_border(const char* name)
+{
+	if (!strcmp(name, "dead"))
+	{
+		return BORDER_DEAD;
+	}
+	else if (!strcmp(name, "alive"))
+	{
+		return BORDER_ALIVE;
+	}
+	else if (!strcmp(name, "torus"))
+	{
+		return BORDER_TORUS;
+	}
+
+	return -1;
+}
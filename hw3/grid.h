@@ -0,0 +1,182 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CELLS_PER_WORD 64
+#define CACHE_LINE_SIZE 64
+#define WORDS_PER_CACHE_LINE (CACHE_LINE_SIZE / 8)
+
+// what lies past the edges of a board
+#define BORDER_DEAD 0
+#define BORDER_ALIVE 1
+#define BORDER_TORUS 2
+
+/*
+ * a life board packed 64 cells to a word, cell c of a row is bit c % 64 of word c / 64. every row has a ghost word on each
+ * side and the board has a ghost row above and below, so the kernels can read the neighbours of edge cells without any
+ * boundary checks. the ghost cells are 0 unless fill_border() sets them, and the ghost column east of the board is the
+ * first bit past the last cell, in the last word's padding when the columns do not fill it
+*/
+typedef struct grid
+{
+	int rows;
+	int cols;
+
+	// words holding the cells of one row
+	int words;
+
+	// words from the start of one row to the start of the next, including the ghost words and the padding
+	int stride;
+
+	// the bits of a row's last word that are real cells. the kernels never write the rest, only fill_border() does
+	uint64_t last_mask;
+
+	uint64_t* cells;
+} grid;
+
+/*
+ * computes a rectangle of the generation after prev into next, rows [start_row, end_row) by words [start_word, end_word).
+ * the rectangle's halo, the row above and below it and the word either side, is read from prev where it is, from the
+ * neighbouring rectangles or from the ghost cells at the edges of the board
+ * params
+ * prev: the current generation
+ * next: where the next generation is written, the same size as prev
+ * start_row: the first row to compute
+ * end_row: one past the last row to compute
+ * start_word: the first word of each row to compute
+ * end_word: one past the last word to compute
+ * same_as_last: set to whether every computed cell is unchanged from prev
+ * all_dead: set to whether every computed cell is dead
+ * returns void
+*/
+typedef void (*step_func)(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, bool* same_as_last,
+	bool* all_dead);
+
+/*
+ * allocates an empty board
+ * params
+ * g: the board to set up
+ * rows: the number of rows
+ * cols: the number of columns
+ * returns
+ * 0 on success, -1 if the memory could not be allocated
+*/
+int init_grid(grid* g, int rows, int cols);
+
+void free_grid(grid* g);
+
+/*
+ * the word-at-a-time kernel. each word of the next generation is computed from the nine words around it, with the
+ * neighbour counts added up bitwise by a tree of full adders so all 64 cells are done at once
+*/
+void step_packed(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, bool* same_as_last,
+	bool* all_dead);
+
+/*
+ * the cell-at-a-time kernel the packed one replaced, kept as a reference to check and benchmark against
+*/
+void step_simple(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, bool* same_as_last,
+	bool* all_dead);
+
+/*
+ * looks up a kernel by name
+ * params
+ * name: "packed" or "simple"
+ * returns
+ * the kernel, or NULL if there is none by that name
+*/
+step_func find_kernel(const char* name);
+
+/*
+ * sets the ghost cells around a board to what the border mode says is past its edges, so any kernel can then compute the
+ * next generation with the border taken into account and no branches for it. run on every new generation before the
+ * next step reads it
+ * params
+ * g: the board
+ * mode: BORDER_DEAD, where the ghost cells are never written and stay 0 so there is nothing to do, BORDER_ALIVE, where
+ * they are all alive, or BORDER_TORUS, where each edge wraps around to the opposite one
+ * returns void
+*/
+void fill_border(grid* g, int mode);
+
+/*
+ * looks up a border mode by name
+ * params
+ * name: "dead", "alive" or "torus"
+ * returns
+ * the mode, or -1 if there is none by that name
+*/
+int find_border(const char* name);
+
+/*
+ * hashes a rectangle of a board, rows [start_row, end_row) by words [start_word, end_word). each word is hashed with its
+ * position and the results are added up, so the hashes of rectangles that tile the board add up to the hash of the whole
+ * board no matter how it was cut
+ * returns
+ * the hash
+*/
+uint64_t hash_rect(grid* g, int start_row, int end_row, int start_word, int end_word);
+
+static inline void full_add(uint64_t a, uint64_t b, uint64_t c, uint64_t* sum, uint64_t* carry)
+{
+	uint64_t t = a ^ b;
+	*sum = t ^ c;
+	*carry = (a & b) | (t & c);
+}
+
+/*
+ * computes 64 cells of the next generation at once. bit i of each argument holds the neighbour in that direction of cell
+ * i, c holds the cells themselves
+ * returns
+ * the cells' next generation
+*/
+static inline uint64_t next_cells(uint64_t a_west, uint64_t a, uint64_t a_east, uint64_t c_west, uint64_t c, uint64_t c_east,
+	uint64_t b_west, uint64_t b, uint64_t b_east)
+{
+	// the eight neighbours added into a three bit count per cell. a count of 8 wraps to 0, which is dead either way
+	uint64_t sum_a, carry_a;
+	uint64_t sum_b, carry_b;
+	full_add(a_west, a, a_east, &sum_a, &carry_a);
+	full_add(c_west, c_east, b_west, &sum_b, &carry_b);
+	uint64_t sum_c = b ^ b_east;
+	uint64_t carry_c = b & b_east;
+
+	uint64_t ones, carry_ones;
+	full_add(sum_a, sum_b, sum_c, &ones, &carry_ones);
+
+	uint64_t twos_low, twos_high;
+	full_add(carry_a, carry_b, carry_c, &twos_low, &twos_high);
+	uint64_t twos = twos_low ^ carry_ones;
+	uint64_t fours = twos_high ^ (twos_low & carry_ones);
+
+	// alive next generation with exactly 3 neighbours, or with 2 if alive now
+	return twos & ~fours & (ones | c);
+}
+
+static inline uint64_t* grid_row(grid* g, int row)
+{
+	return g->cells + (long) (row + 1) * g->stride + 1;
+}
+
+static inline bool get_cell(grid* g, int row, int col)
+{
+	return (grid_row(g, row)[col / CELLS_PER_WORD] >> (col % CELLS_PER_WORD)) & 1;
+}
+
+static inline void set_cell(grid* g, int row, int col, bool alive)
+{
+	uint64_t bit = (uint64_t) 1 << (col % CELLS_PER_WORD);
+
+	if (alive)
+	{
+		grid_row(g, row)[col / CELLS_PER_WORD] |= bit;
+	}
+	else
+	{
+		grid_row(g, row)[col / CELLS_PER_WORD] &= ~bit;
+	}
+}
+
+#endif
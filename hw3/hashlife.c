@@ -0,0 +1,702 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashlife.h"
+
+#define LEAF_LEVEL 3
+#define LEAF_SIZE 8
+
+// the smallest node advance() works on, its result is computed directly rather than from smaller results
+#define BASE_LEVEL 4
+#define BASE_SIZE 16
+
+#define MAX_LEVEL HASHLIFE_MAX_LEVEL
+
+// nodes are allocated this many at a time
+#define SLAB_NODES 65536
+
+#define MIN_BUCKETS 65536
+
+// entries in the cache of results for steps smaller than a node's full step, see advance()
+#define MEMO_SIZE (1 << 18)
+
+// each advance() pins at most this many nodes, and there is one advance() in progress per level
+#define PINS_PER_LEVEL 16
+
+struct node
+{
+	union
+	{
+		// level > LEAF_LEVEL
+		struct
+		{
+			node* nw;
+			node* ne;
+			node* sw;
+			node* se;
+		};
+
+		// leaves, bit r * 8 + c is the cell at row r and column c
+		struct
+		{
+			uint64_t alive;
+			uint64_t wall;
+		};
+	};
+
+	// the centre of the node, half its size, 2^(level - 2) generations later. NULL until it is first needed
+	node* result;
+
+	// the next node in the same hash bucket, or on the free list
+	node* next;
+
+	// 0 for nodes on the free list
+	unsigned char level;
+
+	bool any_alive;
+	bool marked;
+};
+
+typedef struct memo_entry
+{
+	node* key;
+	int step;
+	node* value;
+} memo_entry;
+
+// every node in use is in exactly one bucket
+static node** buckets;
+static size_t num_buckets;
+static long long num_nodes;
+
+static node** slabs;
+static int num_slabs;
+static node* free_nodes;
+
+static memo_entry* memo;
+
+// the all wall node of each level
+static node* walls[MAX_LEVEL + 1];
+
+static int num_collections;
+
+// the universe being advanced and the root it started from, which a collection in the middle of a step has to keep
+static universe* advancing;
+static node* advancing_root;
+
+// the nodes the advance() calls in progress are still working with, kept by a collection along with the roots
+static node* pins[(MAX_LEVEL + 1) * PINS_PER_LEVEL];
+static int num_pins;
+
+// the node bytes past which the next collection happens. normally the universe's max_memory, but when more than that
+// is still in use after a collection it waits until the cache has doubled, so it does not collect over and over
+static size_t collect_at;
+
+static node* find_leaf(uint64_t alive, uint64_t wall);
+static node* find_quad(node* nw, node* ne, node* sw, node* se);
+static node* advance(node* n, int step);
+
+/*
+ * frees every node not reachable from the roots, the walls or the universe's start, and forgets results that point at
+ * freed nodes. only safe between top level steps, when nothing else is holding on to a node
+*/
+static void collect(universe* u, node* root);
+
+static node* pin(node* n)
+{
+	pins[num_pins++] = n;
+	return n;
+}
+
+/*
+ * collects if the nodes have gone past the budget, which can happen in the middle of a step
+*/
+static void check_memory()
+{
+	if (num_nodes * sizeof(node) > collect_at)
+	{
+		collect(advancing, advancing_root);
+	}
+}
+
+static size_t hash_quad(node* nw, node* ne, node* sw, node* se)
+{
+	uint64_t h = (uintptr_t) nw * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (uintptr_t) ne) * 0xC2B2AE3D27D4EB4FULL;
+	h = (h ^ (uintptr_t) sw) * 0x165667B19E3779F9ULL;
+	h = (h ^ (uintptr_t) se) * 0x9E3779B97F4A7C15ULL;
+	return (h ^ (h >> 29)) & (num_buckets - 1);
+}
+
+static size_t hash_leaf(uint64_t alive, uint64_t wall)
+{
+	uint64_t h = alive * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ wall ^ (h >> 31)) * 0xC2B2AE3D27D4EB4FULL;
+	return (h ^ (h >> 29)) & (num_buckets - 1);
+}
+
+static size_t hash_node(node* n)
+{
+	return n->level == LEAF_LEVEL ? hash_leaf(n->alive, n->wall) : hash_quad(n->nw, n->ne, n->sw, n->se);
+}
+
+static node* alloc_node()
+{
+	if (free_nodes == NULL)
+	{
+		node* slab = calloc(SLAB_NODES, sizeof(node));
+		node** grown = realloc(slabs, sizeof(node*) * (num_slabs + 1));
+		if (slab == NULL || grown == NULL)
+		{
+			printf("Out of memory for HashLife nodes.\n");
+			exit(1);
+		}
+
+		slabs = grown;
+		slabs[num_slabs++] = slab;
+
+		for (int i = SLAB_NODES - 1; i >= 0; i--)
+		{
+			slab[i].next = free_nodes;
+			free_nodes = &slab[i];
+		}
+	}
+
+	node* n = free_nodes;
+	free_nodes = n->next;
+	return n;
+}
+
+/*
+ * doubles the hash table once it holds as many nodes as buckets, so chains stay short
+*/
+static void grow_buckets()
+{
+	size_t new_size = num_buckets * 2;
+	node** grown = calloc(new_size, sizeof(node*));
+	if (grown == NULL)
+	{
+		return;
+	}
+
+	node** old = buckets;
+	size_t old_size = num_buckets;
+	buckets = grown;
+	num_buckets = new_size;
+
+	for (size_t i = 0; i < old_size; i++)
+	{
+		node* n = old[i];
+		while (n != NULL)
+		{
+			node* next = n->next;
+			size_t h = hash_node(n);
+			n->next = buckets[h];
+			buckets[h] = n;
+			n = next;
+		}
+	}
+
+	free(old);
+}
+
+static node* insert(node* n, size_t h)
+{
+	n->next = buckets[h];
+	buckets[h] = n;
+
+	if (++num_nodes > (long long) num_buckets)
+	{
+		grow_buckets();
+	}
+
+	return n;
+}
+
+static node* find_leaf(uint64_t alive, uint64_t wall)
+{
+	size_t h = hash_leaf(alive, wall);
+	for (node* n = buckets[h]; n != NULL; n = n->next)
+	{
+		if (n->level == LEAF_LEVEL && n->alive == alive && n->wall == wall)
+		{
+			return n;
+		}
+	}
+
+	node* n = alloc_node();
+	n->alive = alive;
+	n->wall = wall;
+	n->result = NULL;
+	n->level = LEAF_LEVEL;
+	n->any_alive = alive != 0;
+	n->marked = false;
+
+	return insert(n, h);
+}
+
+static node* find_quad(node* nw, node* ne, node* sw, node* se)
+{
+	size_t h = hash_quad(nw, ne, sw, se);
+	for (node* n = buckets[h]; n != NULL; n = n->next)
+	{
+		if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se && n->level > LEAF_LEVEL)
+		{
+			return n;
+		}
+	}
+
+	node* n = alloc_node();
+	n->nw = nw;
+	n->ne = ne;
+	n->sw = sw;
+	n->se = se;
+	n->result = NULL;
+	n->level = nw->level + 1;
+	n->any_alive = nw->any_alive || ne->any_alive || sw->any_alive || se->any_alive;
+	n->marked = false;
+
+	return insert(n, h);
+}
+
+/*
+ * lays a base level node's four leaves out as 16 rows of 16 cells
+*/
+static void base_rows(node* n, uint64_t alive[BASE_SIZE], uint64_t wall[BASE_SIZE])
+{
+	for (int r = 0; r < LEAF_SIZE; r++)
+	{
+		int shift = r * LEAF_SIZE;
+		alive[r] = ((n->nw->alive >> shift) & 0xFF) | (((n->ne->alive >> shift) & 0xFF) << LEAF_SIZE);
+		wall[r] = ((n->nw->wall >> shift) & 0xFF) | (((n->ne->wall >> shift) & 0xFF) << LEAF_SIZE);
+		alive[r + LEAF_SIZE] = ((n->sw->alive >> shift) & 0xFF) | (((n->se->alive >> shift) & 0xFF) << LEAF_SIZE);
+		wall[r + LEAF_SIZE] = ((n->sw->wall >> shift) & 0xFF) | (((n->se->wall >> shift) & 0xFF) << LEAF_SIZE);
+	}
+}
+
+/*
+ * runs a base level node forward directly, a row of 16 cells at a time
+ * returns
+ * the leaf in the middle of the node, generations later. generations can be at most 4, past that the edges of the node
+ * would reach the middle
+*/
+static node* base_advance(node* n, int generations)
+{
+	uint64_t alive[BASE_SIZE];
+	uint64_t wall[BASE_SIZE];
+	base_rows(n, alive, wall);
+
+	for (int g = 0; g < generations; g++)
+	{
+		uint64_t next[BASE_SIZE];
+		for (int r = 0; r < BASE_SIZE; r++)
+		{
+			uint64_t a = r > 0 ? alive[r - 1] : 0;
+			uint64_t c = alive[r];
+			uint64_t b = r < BASE_SIZE - 1 ? alive[r + 1] : 0;
+
+			next[r] = next_cells(a << 1, a, a >> 1, c << 1, c, c >> 1, b << 1, b, b >> 1) & 0xFFFF & ~wall[r];
+		}
+		memcpy(alive, next, sizeof(alive));
+	}
+
+	uint64_t leaf_alive = 0;
+	uint64_t leaf_wall = 0;
+	for (int r = 0; r < LEAF_SIZE; r++)
+	{
+		leaf_alive |= ((alive[r + LEAF_SIZE / 2] >> (LEAF_SIZE / 2)) & 0xFF) << (r * LEAF_SIZE);
+		leaf_wall |= ((wall[r + LEAF_SIZE / 2] >> (LEAF_SIZE / 2)) & 0xFF) << (r * LEAF_SIZE);
+	}
+
+	return find_leaf(leaf_alive, leaf_wall);
+}
+
+// the node half the size of n in its middle
+static node* centre(node* n)
+{
+	if (n->level == BASE_LEVEL)
+	{
+		return base_advance(n, 0);
+	}
+
+	return find_quad(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+// the node straddling the border between w and e, which are side by side
+static node* centre_horizontal(node* w, node* e)
+{
+	return find_quad(w->ne, e->nw, w->se, e->sw);
+}
+
+// the node straddling the border between n and s, which are one above the other
+static node* centre_vertical(node* n, node* s)
+{
+	return find_quad(n->sw, n->se, s->nw, s->ne);
+}
+
+/*
+ * the heart of HashLife. the node is cut into nine overlapping nodes half its size, each is advanced, and the results are
+ * put together into four nodes that are advanced again, or just cut down for steps smaller than the full one
+ * params
+ * n: a node at level BASE_LEVEL or more
+ * step: runs 2^step generations, at most 2^(level - 2)
+ * returns
+ * the centre of n, half its size, 2^step generations later
+*/
+static node* advance(node* n, int step)
+{
+	if (n->level == BASE_LEVEL)
+	{
+		return base_advance(n, 1 << step);
+	}
+
+	bool full = step == n->level - 2;
+	memo_entry* entry = &memo[(((uintptr_t) n >> 4) * 0x9E3779B97F4A7C15ULL + step) % MEMO_SIZE];
+
+	if (full && n->result != NULL)
+	{
+		return n->result;
+	}
+	else if (!full && entry->key == n && entry->step == step)
+	{
+		return entry->value;
+	}
+
+	// everything this call still needs is pinned, any of the calls below can collect. a node made just to be advanced is
+	// pinned by the call it is passed to before anything can collect
+	int pinned = num_pins;
+	pin(n);
+	check_memory();
+
+	// a full step is split in two halves, a smaller one is done entirely by the first round
+	int first = full ? step - 1 : step;
+
+	node* r00 = pin(advance(n->nw, first));
+	node* r01 = pin(advance(centre_horizontal(n->nw, n->ne), first));
+	node* r02 = pin(advance(n->ne, first));
+	node* r10 = pin(advance(centre_vertical(n->nw, n->sw), first));
+	node* r11 = pin(advance(centre(n), first));
+	node* r12 = pin(advance(centre_vertical(n->ne, n->se), first));
+	node* r20 = pin(advance(n->sw, first));
+	node* r21 = pin(advance(centre_horizontal(n->sw, n->se), first));
+	node* r22 = pin(advance(n->se, first));
+
+	node* q_nw = pin(find_quad(r00, r01, r10, r11));
+	node* q_ne = pin(find_quad(r01, r02, r11, r12));
+	node* q_sw = pin(find_quad(r10, r11, r20, r21));
+	node* q_se = pin(find_quad(r11, r12, r21, r22));
+
+	node* result;
+	if (full)
+	{
+		node* nw = pin(advance(q_nw, step - 1));
+		node* ne = pin(advance(q_ne, step - 1));
+		node* sw = pin(advance(q_sw, step - 1));
+		node* se = advance(q_se, step - 1);
+		result = find_quad(nw, ne, sw, se);
+		n->result = result;
+	}
+	else
+	{
+		result = find_quad(centre(q_nw), centre(q_ne), centre(q_sw), centre(q_se));
+		entry->key = n;
+		entry->step = step;
+		entry->value = result;
+	}
+
+	num_pins = pinned;
+
+	return result;
+}
+
+/*
+ * builds the node covering the square at (row, col) of the root, where the board starts at (offset, offset)
+*/
+static node* build(universe* u, grid* g, int level, long long row, long long col, long long offset)
+{
+	long long size = 1LL << level;
+
+	if (row + size <= offset || row >= offset + u->rows || col + size <= offset || col >= offset + u->cols)
+	{
+		return walls[level];
+	}
+
+	if (level == LEAF_LEVEL)
+	{
+		uint64_t alive = 0;
+		uint64_t wall = 0;
+		for (int r = 0; r < LEAF_SIZE; r++)
+		{
+			for (int c = 0; c < LEAF_SIZE; c++)
+			{
+				long long y = row + r - offset;
+				long long x = col + c - offset;
+				uint64_t bit = (uint64_t) 1 << (r * LEAF_SIZE + c);
+
+				if (y < 0 || y >= u->rows || x < 0 || x >= u->cols)
+				{
+					wall |= bit;
+				}
+				else if (get_cell(g, y, x))
+				{
+					alive |= bit;
+				}
+			}
+		}
+		return find_leaf(alive, wall);
+	}
+
+	long long half = size / 2;
+	return find_quad(build(u, g, level - 1, row, col, offset), build(u, g, level - 1, row, col + half, offset),
+		build(u, g, level - 1, row + half, col, offset), build(u, g, level - 1, row + half, col + half, offset));
+}
+
+int init_universe(universe* u, grid* g, long long max_generations, size_t max_memory)
+{
+	u->rows = g->rows;
+	u->cols = g->cols;
+	u->max_memory = max_memory;
+	collect_at = max_memory;
+
+	if (max_generations > HASHLIFE_MAX_GENERATIONS)
+	{
+		return -1;
+	}
+
+	// the board has to fit in the middle half of the root
+	int level = BASE_LEVEL + 1;
+	while ((1LL << (level - 1)) < g->rows || (1LL << (level - 1)) < g->cols)
+	{
+		level++;
+	}
+
+	// and the root has to be big enough to take the largest power of two step in one go
+	while (level < MAX_LEVEL && (1LL << (level - 2)) <= max_generations / 2)
+	{
+		level++;
+	}
+	u->level = level;
+
+	num_buckets = MIN_BUCKETS;
+	buckets = calloc(num_buckets, sizeof(node*));
+	memo = calloc(MEMO_SIZE, sizeof(memo_entry));
+	if (buckets == NULL || memo == NULL)
+	{
+		return -1;
+	}
+
+	walls[LEAF_LEVEL] = find_leaf(0, ~(uint64_t) 0);
+	for (int i = LEAF_LEVEL + 1; i <= level; i++)
+	{
+		walls[i] = find_quad(walls[i - 1], walls[i - 1], walls[i - 1], walls[i - 1]);
+	}
+
+	u->start = build(u, g, level, 0, 0, 1LL << (level - 2));
+
+	return 0;
+}
+
+void free_universe(universe* u)
+{
+	for (int i = 0; i < num_slabs; i++)
+	{
+		free(slabs[i]);
+	}
+	free(slabs);
+	free(buckets);
+	free(memo);
+
+	slabs = NULL;
+	num_slabs = 0;
+	buckets = NULL;
+	num_nodes = 0;
+	free_nodes = NULL;
+	memo = NULL;
+	u->start = NULL;
+}
+
+node* hashlife_advance(universe* u, node* root, long long generations)
+{
+	for (int step = 0; generations > 0; step++, generations >>= 1)
+	{
+		if ((generations & 1) == 0)
+		{
+			continue;
+		}
+
+		advancing = u;
+		advancing_root = root;
+		check_memory();
+
+		// the result is the middle half of the root, which holds the whole board. it is put back in the middle of a root
+		// the same size, with walls all around
+		node* r = advance(root, step);
+		node* w = walls[u->level - 2];
+		root = find_quad(find_quad(w, w, w, r->nw), find_quad(w, w, r->ne, w), find_quad(w, r->sw, w, w),
+			find_quad(r->se, w, w, w));
+	}
+
+	return root;
+}
+
+bool hashlife_alive(node* root)
+{
+	return root->any_alive;
+}
+
+static void extract(universe* u, node* n, grid* g, long long row, long long col, long long offset)
+{
+	long long size = 1LL << n->level;
+
+	if (!n->any_alive || row + size <= offset || row >= offset + u->rows || col + size <= offset || col >= offset + u->cols)
+	{
+		return;
+	}
+
+	if (n->level == LEAF_LEVEL)
+	{
+		for (int i = 0; i < LEAF_SIZE * LEAF_SIZE; i++)
+		{
+			if ((n->alive >> i) & 1)
+			{
+				set_cell(g, row + i / LEAF_SIZE - offset, col + i % LEAF_SIZE - offset, true);
+			}
+		}
+		return;
+	}
+
+	long long half = size / 2;
+	extract(u, n->nw, g, row, col, offset);
+	extract(u, n->ne, g, row, col + half, offset);
+	extract(u, n->sw, g, row + half, col, offset);
+	extract(u, n->se, g, row + half, col + half, offset);
+}
+
+void hashlife_to_grid(universe* u, node* root, grid* g)
+{
+	for (int r = 0; r < g->rows; r++)
+	{
+		memset(grid_row(g, r), 0, g->words * sizeof(uint64_t));
+	}
+
+	extract(u, root, g, 0, 0, 1LL << (u->level - 2));
+}
+
+static void mark(node* n)
+{
+	if (n == NULL || n->marked)
+	{
+		return;
+	}
+
+	n->marked = true;
+	if (n->level > LEAF_LEVEL)
+	{
+		mark(n->nw);
+		mark(n->ne);
+		mark(n->sw);
+		mark(n->se);
+	}
+}
+
+static void collect(universe* u, node* root)
+{
+	mark(u->start);
+	mark(root);
+	for (int i = LEAF_LEVEL; i <= u->level; i++)
+	{
+		mark(walls[i]);
+	}
+	for (int i = 0; i < num_pins; i++)
+	{
+		mark(pins[i]);
+	}
+
+	memset(buckets, 0, num_buckets * sizeof(node*));
+	memset(memo, 0, MEMO_SIZE * sizeof(memo_entry));
+	num_nodes = 0;
+	free_nodes = NULL;
+
+	// results that are about to be freed are forgotten first, they can be in a slab that goes. a slab with nothing left
+	// in it is given back, the last slab takes its place
+	for (int s = 0; s < num_slabs; s++)
+	{
+		bool empty = true;
+		for (int i = 0; i < SLAB_NODES; i++)
+		{
+			node* n = &slabs[s][i];
+			if (n->marked)
+			{
+				empty = false;
+				if (n->result != NULL && !n->result->marked)
+				{
+					n->result = NULL;
+				}
+			}
+		}
+
+		if (empty)
+		{
+			free(slabs[s]);
+			slabs[s--] = slabs[--num_slabs];
+		}
+	}
+
+	// the buckets are rebuilt from the nodes that survive
+	for (int s = 0; s < num_slabs; s++)
+	{
+		for (int i = 0; i < SLAB_NODES; i++)
+		{
+			node* n = &slabs[s][i];
+			if (n->level == 0)
+			{
+				n->next = free_nodes;
+				free_nodes = n;
+				continue;
+			}
+
+			if (n->marked)
+			{
+				size_t h = hash_node(n);
+				n->next = buckets[h];
+				buckets[h] = n;
+				num_nodes++;
+			}
+			else
+			{
+				n->level = 0;
+				n->next = free_nodes;
+				free_nodes = n;
+			}
+		}
+	}
+
+	for (int s = 0; s < num_slabs; s++)
+	{
+		for (int i = 0; i < SLAB_NODES; i++)
+		{
+			slabs[s][i].marked = false;
+		}
+	}
+
+	size_t used = num_nodes * sizeof(node);
+	collect_at = used * 2 > u->max_memory ? used * 2 : u->max_memory;
+
+	num_collections++;
+}
+
+long long hashlife_nodes()
+{
+	return num_nodes;
+}
+
+size_t hashlife_memory()
+{
+	return (size_t) num_slabs * SLAB_NODES * sizeof(node) + num_buckets * sizeof(node*) + MEMO_SIZE * sizeof(memo_entry);
+}
+
+int hashlife_collections()
+{
+	return num_collections;
+}
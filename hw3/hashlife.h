@@ -0,0 +1,99 @@
+#ifndef HASHLIFE_H
+#define HASHLIFE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "grid.h"
+
+// the largest root is 2^HASHLIFE_MAX_LEVEL cells on a side, which takes a step of at most 2^(HASHLIFE_MAX_LEVEL - 2)
+// generations at a time, so this is the most generations a universe can run
+#define HASHLIFE_MAX_LEVEL 62
+#define HASHLIFE_MAX_GENERATIONS ((1LL << (HASHLIFE_MAX_LEVEL - 1)) - 1)
+
+/*
+ * a square of the universe in HashLife's quadtree. a node at level n is 2^n cells on a side, made of four nodes at level
+ * n - 1. the leaves are 8x8 blocks. nodes are hash-consed, so two equal squares anywhere in any generation are the same
+ * node and can be compared by pointer
+*/
+typedef struct node node;
+
+/*
+ * a board under HashLife. the board sits in the middle of the root node and everything around it is wall: cells that
+ * are always dead. that keeps the edges behaving exactly as they do in the other engines, where cells past the edge
+ * never come alive
+*/
+typedef struct universe
+{
+	int rows;
+	int cols;
+
+	// the level of every root node, big enough for the board and for the longest step asked for
+	int level;
+
+	// generation 0
+	node* start;
+
+	// once the nodes take up more than this many bytes, the ones nothing still needs are freed along with stale results,
+	// in the middle of a step if need be, and slabs left empty are given back. it covers the nodes only, the hash table
+	// and the result cache come on top. when more than this is still needed after a collection, the next one waits
+	// until the nodes have doubled
+	size_t max_memory;
+} universe;
+
+/*
+ * builds the starting node from a board
+ * params
+ * u: the universe to set up
+ * g: the board
+ * max_generations: the most generations that will be asked for in one call to hashlife_advance(), at most
+ * HASHLIFE_MAX_GENERATIONS
+ * max_memory: see universe
+ * returns
+ * 0 on success, -1 if memory ran out or max_generations is too many
+*/
+int init_universe(universe* u, grid* g, long long max_generations, size_t max_memory);
+
+void free_universe(universe* u);
+
+/*
+ * runs the universe forward. the number of generations is split into powers of two, and each one is a single memoized
+ * HashLife step, so the cost grows with how much the pattern changes and not with the number of generations
+ * params
+ * u: the universe
+ * root: the generation to start from, u->start or a node returned by an earlier call
+ * generations: the number of generations to run
+ * returns
+ * the root node of the generation reached
+*/
+node* hashlife_advance(universe* u, node* root, long long generations);
+
+/*
+ * returns
+ * whether the board in root has any live cells
+*/
+bool hashlife_alive(node* root);
+
+/*
+ * copies the board in root into g, which must be the size of the universe's board
+*/
+void hashlife_to_grid(universe* u, node* root, grid* g);
+
+/*
+ * returns
+ * the number of nodes currently cached
+*/
+long long hashlife_nodes();
+
+/*
+ * returns
+ * the bytes allocated for nodes and the tables that find them
+*/
+size_t hashlife_memory();
+
+/*
+ * returns
+ * how many times the cache has been garbage collected
+*/
+int hashlife_collections();
+
+#endif
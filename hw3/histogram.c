@@ -0,0 +1,60 @@
+#include "histogram.h"
+
+// values below HISTOGRAM_SUB_BUCKETS get a bucket each, above that a bucket is the value's top 5 significant bits
+#define SUB_BITS 4
+
+static int bucket_of(uint64_t value)
+{
+	if (value < HISTOGRAM_SUB_BUCKETS)
+	{
+		return value;
+	}
+
+	int top = 63 - __builtin_clzll(value);
+	int sub = (value >> (top - SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+	return (top - SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/*
+ * returns
+ * the middle of a bucket
+*/
+static uint64_t bucket_value(int bucket)
+{
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t) (HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+
+	return low + (((uint64_t) 1 << shift) >> 1);
+}
+
+void histogram_add(histogram* h, uint64_t value)
+{
+	h->counts[bucket_of(value)]++;
+	h->total++;
+}
+
+uint64_t histogram_percentile(histogram* h, double percent)
+{
+	// the value at least percent of the values are at or below
+	double exact = h->total * percent / 100;
+	long long rank = (long long) exact;
+	rank += rank < exact || rank < 1;
+
+	long long seen = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= rank)
+		{
+			return bucket_value(i);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// each power of two is split into this many buckets, so a bucket is never wider than 1/16 of the values in it
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * counts of values, kept to within a few percent so any number of them fit in the same fixed amount of memory. used for
+ * latencies, where the percentiles matter and the exact nanosecond does not
+*/
+typedef struct histogram
+{
+	long long counts[HISTOGRAM_BUCKETS];
+	long long total;
+} histogram;
+
+/*
+ * adds a value to a histogram, which starts out zeroed
+*/
+void histogram_add(histogram* h, uint64_t value);
+
+/*
+ * params
+ * h: the histogram
+ * percent: which percentile, from 0 to 100
+ * returns
+ * the middle of the bucket the percentile falls in, or 0 if the histogram is empty
+*/
+uint64_t histogram_percentile(histogram* h, double percent);
+
+#endif
@@ -1,10 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "mailbox.h"
-
-#define MAXGRID 40
+#include "barrier.h"
+#include "grid.h"
+#include "pattern.h"
+#include "hashlife.h"
+#include "rule.h"
+#include "writer.h"
+#include "checkpoint.h"
+#include "histogram.h"
 
 #define RANGE 1
 #define ALLDONE 2
@@ -14,31 +26,381 @@
 #define SAMEASLAST 6
 #define ALLDEADANDSAME 7
 
-#define MAXTHREAD 10
+#define MAXTHREAD 1024
+
+#define SYNC_MAILBOX 0
+#define SYNC_BARRIER 1
+
+// the tile size -a uses when -t is not given, two 4KB tiles of the current and next generation fit easily in L1
+#define DEFAULT_TILE_ROWS 64
+#define DEFAULT_TILE_COLS 512
+
+// how many megabytes of nodes HashLife keeps before it collects the ones it no longer needs, unless -M says otherwise.
+// see universe for what that covers
+#define DEFAULT_CACHE_MB 256
+
+// how many bands reported each result for one generation, counted the way the mailbox coordinator counts reply types
+typedef struct tally
+{
+	_Atomic int same_as_last;
+	_Atomic int all_dead;
+
+	// the sum of the bands' hashes, the hash of the whole generation
+	_Atomic uint64_t hash;
+} tally;
+
+// a rectangle of the board computed as one piece of work in tiled mode
+typedef struct tile
+{
+	int start_row;
+	int end_row;
+	int start_word;
+	int end_word;
+} tile;
+
+// generation n is in grids[n % 2]
+grid grids[2];
+
+// tiled mode: the board cut into tiles with -t, and the queue of them the workers take from. next_tile is the index of the
+// first tile nobody has taken yet this generation. num_tiles is 0 when the board is split into bands instead
+tile* tiles;
+int num_tiles;
+_Atomic int next_tile;
+int tiles_across;
+
+// active tracking, turned on with -a: bit t of changed[n % 2] is set if tile t changed in the step that produced
+// generation n. a tile whose neighbourhood did not change in the last step is skipped, its next generation is the same
+// as its current one and is already in the other buffer since the tile itself did not change either. tile_alive[t] is
+// whether tile t had a live cell the last time it was computed
+bool track_active;
+_Atomic uint64_t* changed[2];
+bool* tile_alive;
+_Atomic long long tiles_skipped;
+
+// cycle detection, turned on with -c: the workers hash what they compute and the hash of generation n is kept in
+// history[n % CYCLE_HISTORY] for every n from history_from on. once a generation's hash matches one from fewer than
+// CYCLE_HISTORY generations ago, the game stops and cycle_gen is the generation that repeated, period generations after
+// the one it repeats. tile_hash[t] is the hash of tile t the last time it was computed, which still holds while it is
+// being skipped
+bool detect_cycles;
+uint64_t history[CYCLE_HISTORY];
+long long history_from;
+_Atomic int period;
+long long cycle_gen;
+uint64_t* tile_hash;
 
-bool even_grid[MAXGRID][MAXGRID];
-bool odd_grid[MAXGRID][MAXGRID];
+// computes the next generation for the workers, chosen with -k
+step_func step = step_packed;
 
-int num_rows;
-int num_columns;
+// how the workers agree that a generation is done, chosen with -m
+int sync_mode = SYNC_MAILBOX;
+
+int num_workers;
+long long max_generations;
+bool print_all;
+
+// -q: the board the game ended with is not printed, for timing runs that only want the stats
+bool quiet;
+
+// barrier mode: the barrier workers wait at after each generation, and the tally of generation n in tallies[n % 2]
+barrier gen_barrier;
+tally tallies[2];
+
+// barrier mode: the generation the workers stopped at and its tally, set by worker 1 as it leaves
+long long final_gen;
+int final_same_as_last;
+int final_all_dead;
+
+// nanoseconds all workers together spent waiting for the others between generations
+_Atomic long long sync_ns;
+
+// how long each generation took, from the end of the one before it to the end of it. last_gen_end is only touched by
+// whoever runs reset_generation()
+histogram gen_latency;
+struct timespec last_gen_end;
+
+// snapshots, turned on with -w: every save_every-th generation is saved to <save_prefix>-<generation>.rle
+long long save_every;
+const char* save_prefix = "life";
+
+// checkpoints, turned on with -C: every checkpoint_every-th generation is checkpointed to <save_prefix>.ckpt, which
+// --resume starts from. first_gen is the generation the run starts at, 0 unless it was resumed
+long long checkpoint_every;
+long long first_gen;
+
+// the rule, chosen with -r or taken from the checkpoint
+rule life_rule = {1 << 3, 1 << 2 | 1 << 3};
+
+// the rule as a rulestring, for the stats and the snapshots
+char rule_name[24];
+
+// what lies past the edges of the board, chosen with -b or taken from the checkpoint. the ghost cells of every new
+// generation are filled in for it before the next step reads them
+int border = BORDER_DEAD;
+const char* border_names[] = {"dead", "alive", "torus"};
+
+// milliseconds the game was held up handing boards to the writer or waiting for it to finish, left out of the simulation
+// time
+double print_ms;
 
 void* worker_func(void* id);
 
-void print_gen(int gen_number, bool last);
+/*
+ * the worker used in barrier mode. after each generation the workers add their band's result to that generation's tally
+ * and wait at gen_barrier, after which every worker sees the same totals and makes the same decision the mailbox
+ * coordinator would have made, without a round trip through box 0
+ * params
+ * id: points to the worker's id, the box its row range is sent to
+ * returns
+ * NULL
+*/
+void* barrier_worker_func(void* id);
+
+/*
+ * gets ready for the step after generation gen is computed: times it, fills in the new generation's ghost cells,
+ * clears a tally and the changed bitmap for reuse and empties the tile queue. run by the last worker to reach the barrier,
+ * or by main before it sends GO. everyone has finished reading the tally and bitmap, which were used two generations ago,
+ * and no one can touch them or the new generation until they are released
+ * params
+ * gen: points to the generation the workers are about to compute from
+ * returns void
+*/
+void reset_generation(void* gen);
+
+/*
+ * what the last worker to reach the barrier does after a generation is computed: looks for a repeat if -c is on, then
+ * resets for the next step
+ * params
+ * gen: points to the generation the workers computed from
+ * returns void
+*/
+void end_generation(void* gen);
+
+/*
+ * records the hash of a generation and looks for an earlier generation with the same hash
+ * params
+ * gen: the generation number
+ * hash: its hash
+ * returns
+ * whether gen repeats an earlier generation, in which case period and cycle_gen are set
+*/
+bool find_period(long long gen, uint64_t hash);
+
+void print_cycle();
+
+/*
+ * computes a worker's share of the next generation: its band of rows, or in tiled mode whatever tiles it can take from
+ * the queue before it runs dry
+ * params
+ * gen: the number of the current generation
+ * prev: the current generation
+ * next: where the next generation is written
+ * start_row: the first row of the worker's band
+ * end_row: one past the last row of the band
+ * same_as_last: set to whether everything the worker computed is unchanged
+ * all_dead: set to whether everything the worker computed is dead
+ * hash: set to the hash of everything the worker computed, if -c is on
+ * returns void
+*/
+void compute_share(long long gen, grid* prev, grid* next, int start_row, int end_row, bool* same_as_last, bool* all_dead,
+	uint64_t* hash);
+
+/*
+ * returns
+ * whether tile t or any tile touching it changed in the step that produced generation gen
+*/
+bool neighbourhood_changed(int t, long long gen);
+
+/*
+ * cuts the board into tiles, in row major order so consecutive tiles share halo rows
+ * params
+ * tile_rows: the number of rows in a tile
+ * tile_cols: the number of columns in a tile, rounded up to whole words
+ * returns
+ * 0 on success, -1 if the tile list could not be allocated
+*/
+int make_tiles(int tile_rows, int tile_cols);
+
+/*
+ * allocates the bitmaps for active tracking
+ * returns
+ * 0 on success, -1 if they could not be allocated
+*/
+int init_active_tracking();
+
+/*
+ * runs the game with HashLife instead of the workers. prints the same boards, with the same headers, that the workers
+ * would have for the same arguments
+ * params
+ * u: the universe, starting from the loaded board
+ * first: the generation the loaded board is
+ * num_generations: the generation to stop at
+ * print: whether every generation is printed
+ * returns
+ * the number of generations computed
+*/
+long long run_hashlife(universe* u, long long first, long long num_generations, bool print);
+
+/*
+ * returns
+ * whether the game stops at generation gen because it is the same as the one after it or the one after it is empty
+*/
+bool hashlife_stops(universe* u, node* gen);
+
+/*
+ * copies a generation out of HashLife into the grid print_gen() prints it from
+*/
+void show_hashlife(universe* u, node* root, long long gen_number, bool last);
+
+/*
+ * hands a generation to the writer to be printed, unless it is the last one and -q is on
+ * params
+ * gen_number: the generation, in grids[gen_number % 2]
+ * last: whether it is printed as the board the game ended with
+ * returns void
+*/
+void print_gen(long long gen_number, bool last);
+
+/*
+ * hands a generation to the writer to be saved as a snapshot, a checkpoint or both, whichever are due
+*/
+void save_gen(long long gen_number);
+
+/*
+ * returns
+ * whether generation gen_number is one -w or -C saves
+*/
+bool save_due(long long gen_number);
+
+/*
+ * returns
+ * the first generation at or after gen_number that -w or -C saves, LLONG_MAX if neither is on
+*/
+long long next_save(long long gen_number);
+
+/*
+ * waits for the writer to finish everything it was handed and stops it
+*/
+void finish_output();
+
+/*
+ * returns
+ * the milliseconds from start to end
+*/
+double elapsed_ms(struct timespec* start, struct timespec* end);
 
 int main(int argc, char* argv[])
 {
+	// when set, how long loading and simulating took is printed at the end
+	bool stats = false;
+
+	int tile_rows = 0;
+	int tile_cols = 0;
+
+	// -H runs the game with HashLife, keeping about cache_mb megabytes of nodes
+	bool hashlife = false;
+	long long cache_mb = DEFAULT_CACHE_MB;
+
+	// --resume starts from the last checkpoint instead of the file
+	bool resume = false;
+	static struct option long_options[] =
+	{
+		{"resume", no_argument, NULL, 'R'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "ab:C:cHk:m:M:o:qr:st:w:", long_options, NULL)) != -1)
+	{
+		if (opt == 'k' && find_kernel(optarg) != NULL)
+		{
+			step = find_kernel(optarg);
+		}
+		else if (opt == 'm' && (!strcmp(optarg, "mailbox") || !strcmp(optarg, "barrier")))
+		{
+			sync_mode = !strcmp(optarg, "barrier") ? SYNC_BARRIER : SYNC_MAILBOX;
+		}
+		else if (opt == 's')
+		{
+			stats = true;
+		}
+		else if (opt == 'q')
+		{
+			quiet = true;
+		}
+		else if (opt == 'a')
+		{
+			track_active = true;
+		}
+		else if (opt == 'c')
+		{
+			detect_cycles = true;
+		}
+		else if (opt == 'b' && find_border(optarg) != -1)
+		{
+			border = find_border(optarg);
+		}
+		else if (opt == 'r' && parse_rule(optarg, &life_rule) == 0)
+		{
+			// the kernel is picked once all the options are in, since -k and -H have a say
+		}
+		else if (opt == 'w' && sscanf(optarg, "%lld", &save_every) == 1 && save_every > 0)
+		{
+			// the period was read straight into save_every
+		}
+		else if (opt == 'o')
+		{
+			save_prefix = optarg;
+		}
+		else if (opt == 'C' && sscanf(optarg, "%lld", &checkpoint_every) == 1 && checkpoint_every > 0)
+		{
+			// the period was read straight into checkpoint_every
+		}
+		else if (opt == 'R')
+		{
+			resume = true;
+		}
+		else if (opt == 'H')
+		{
+			hashlife = true;
+		}
+		else if (opt == 'M' && sscanf(optarg, "%lld", &cache_mb) == 1 && cache_mb > 0)
+		{
+			// the size was read straight into cache_mb
+		}
+		else if (opt == 't' && sscanf(optarg, "%d", &tile_rows) == 1 && tile_rows > 0)
+		{
+			// <rows>x<cols>, or just <rows> for a square tile
+			tile_cols = tile_rows;
+			char* x = strchr(optarg, 'x');
+			if (x != NULL && (sscanf(x + 1, "%d", &tile_cols) != 1 || tile_cols <= 0))
+			{
+				argc = 0;
+				break;
+			}
+		}
+		else
+		{
+			argc = 0;
+			break;
+		}
+	}
+
+	// the positional arguments are handled as if the options were never there
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if (argc != 4 && argc != 5)
 	{
-		printf("Incorrect usage. Proper usage: ./life <num_threads> <filename> <num_generations> <OPTIONAL:print(y/n)>\n");
+		printf("Incorrect usage. Proper usage: ./life [-a] [-b dead|alive|torus] [-C every] [-c] [-H] [-k packed|simple] [-M cache_mb] [-m mailbox|barrier] [-o prefix] [-q] [-r rule] [-s] [-t rows[xcols]] [-w every] [--resume] <num_threads> <filename> <num_generations> <OPTIONAL:print(y/n)>\n");
 		return 1;
 	}
 
 	int num_threads;
-	int num_generations;
+	long long num_generations;
 
 	num_threads = atoi(argv[1]);
-	num_generations = atoi(argv[3]);
+	num_generations = atoll(argv[3]);
 
 	if (num_threads <= 0 || num_generations <= 0)
 	{
@@ -48,7 +410,15 @@ int main(int argc, char* argv[])
 
 	if (num_threads > MAXTHREAD)
 	{
-		printf("Number of threads cannot exceed 10.\n");
+		printf("Number of threads cannot exceed %d.\n", MAXTHREAD);
+		return 1;
+	}
+
+	// past this HashLife's root would be too big to address. the workers would never get that far one generation at a
+	// time, so it is the limit for them too
+	if (num_generations > HASHLIFE_MAX_GENERATIONS)
+	{
+		printf("Number of generations cannot exceed %lld.\n", HASHLIFE_MAX_GENERATIONS);
 		return 1;
 	}
 
@@ -62,57 +432,171 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	FILE* f = fopen(argv[2], "r");
+	struct timespec load_start;
+	struct timespec sim_start;
+	struct timespec sim_end;
+	clock_gettime(CLOCK_MONOTONIC, &load_start);
 
-	if (f == NULL)
+	// a resumed run carries on exactly where the checkpoint left off: same generation, rule and hashes, so it prints what
+	// the run that wrote it would have gone on to print. the file given is not read
+	bool resumed_history = false;
+	if (resume)
+	{
+		char path[4096];
+		snprintf(path, sizeof(path), "%s.ckpt", save_prefix);
+
+		grid loaded;
+		checkpoint c;
+		if (load_checkpoint(path, &loaded, &c) != 0)
+		{
+			return 1;
+		}
+
+		if (c.generation > num_generations)
+		{
+			printf("The checkpoint is at generation %lld, past the end of the run.\n", c.generation);
+			return 1;
+		}
+
+		first_gen = c.generation;
+		grids[first_gen % 2] = loaded;
+		life_rule = c.life_rule;
+		border = c.border;
+
+		if (c.history_from >= 0)
+		{
+			memcpy(history, c.history, sizeof(history));
+			history_from = c.history_from;
+			resumed_history = true;
+		}
+	}
+	else if (load_pattern(argv[2], &grids[0]) != 0)
 	{
-		printf("Could not open file.\n");
 		return 1;
 	}
 
-	char buf[MAXGRID * 2 + 1];
+	grid* start = &grids[first_gen % 2];
+	int rows = start->rows;
+	int cols = start->cols;
+
+	if (init_grid(&grids[(first_gen + 1) % 2], rows, cols) != 0)
+	{
+		printf("Could not allocate the grid.\n");
+		return 1;
+	}
 
-	int rows = 0;
-	int cols;
-	while (fgets(buf, MAXGRID * 2 + 1, f))
+	// B3/S23 keeps whatever kernel -k chose, every other rule runs on its own kernel or the runtime one
+	step_func rule_step = specialized_kernel(&life_rule);
+	bool conway = rule_step == step_packed;
+	if (!conway && (hashlife || step == step_simple))
 	{
-		cols = 0;
+		printf("Rules other than B3/S23 only run on the packed kernel, not the simple one or HashLife.\n");
+		return 1;
+	}
+	else if (!conway)
+	{
+		step = rule_step != NULL ? rule_step : runtime_kernel(&life_rule);
+	}
 
-		if (rows >= 40)
+	// HashLife's universe is surrounded by dead cells and nothing else
+	if (border != BORDER_DEAD && hashlife)
+	{
+		printf("HashLife only runs with a dead border.\n");
+		return 1;
+	}
+	fill_border(start, border);
+
+	format_rule(&life_rule, rule_name);
+	if (start_writer(rows, cols, rule_name, save_prefix) != 0)
+	{
+		printf("Could not start the writer.\n");
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sim_start);
+
+	if (hashlife)
+	{
+		// HashLife does not hash generations, so its checkpoints carry no history
+		detect_cycles = false;
+
+		universe u;
+		if (init_universe(&u, start, num_generations - first_gen, (size_t) cache_mb << 20) != 0)
 		{
-			printf("Number of rows must not exceed 40.\n");
-			fclose(f);
+			printf("Could not allocate the HashLife tables.\n");
 			return 1;
 		}
 
-		int i;
-		for (i = 0; buf[i] != '\0'; i++)
-		{
-			if (buf[i] == '1' || buf[i] == '0')
-			{
-				even_grid[rows][cols] = (buf[i] == '1');
-				cols++;
-			}
-		}
+		long long generations_computed = run_hashlife(&u, first_gen, num_generations, print);
+		finish_output();
+
+		clock_gettime(CLOCK_MONOTONIC, &sim_end);
 
-		if (i == MAXGRID * 2 && buf[MAXGRID * 2 - 1] != '\n')
+		if (stats)
 		{
-			printf("Number of columns must not exceed 40.\n");
-			fclose(f);
-			return 1;
+			double sim_ms = elapsed_ms(&sim_start, &sim_end) - print_ms;
+			printf("-->Run Stats<--\n");
+			printf("Grid: %d x %d\n", rows, cols);
+			printf("Load Time: %.3fms\n", elapsed_ms(&load_start, &sim_start));
+			printf("Simulation Time: %.3fms\n", sim_ms);
+			printf("Print Time: %.3fms\n", print_ms);
+			printf("Generations Computed: %lld\n", generations_computed);
+			printf("Cells Per Second: %.3g\n", (double) rows * cols * generations_computed / (sim_ms / 1000));
+			printf("Nodes Cached: %lld\n", hashlife_nodes());
+			printf("Memory Used: %.1fMB\n", hashlife_memory() / 1048576.0);
+			printf("Garbage Collections: %d\n", hashlife_collections());
 		}
 
-		rows++;
+		free_universe(&u);
+		free_grid(&grids[0]);
+		free_grid(&grids[1]);
+
+		return 0;
+	}
+
+	// changes are tracked per tile, so -a needs tiles
+	if (track_active && tile_rows == 0)
+	{
+		tile_rows = DEFAULT_TILE_ROWS;
+		tile_cols = DEFAULT_TILE_COLS;
+	}
+
+	if (tile_rows > 0 && make_tiles(tile_rows, tile_cols) != 0)
+	{
+		printf("Could not allocate the tiles.\n");
+		return 1;
 	}
 
-	fclose(f);
+	if (track_active && init_active_tracking() != 0)
+	{
+		printf("Could not allocate the active tracking bitmaps.\n");
+		return 1;
+	}
+
+	if (detect_cycles && !resumed_history)
+	{
+		// the workers only ever hash what they compute, which starts at the generation after the first
+		history_from = first_gen;
+		find_period(first_gen, hash_rect(start, 0, rows, 0, start->words));
+	}
 
-	num_rows = rows;
-	num_columns = cols;
+	if (detect_cycles)
+	{
+		if (num_tiles > 0 && (tile_hash = calloc(num_tiles, sizeof(uint64_t))) == NULL)
+		{
+			printf("Could not allocate the tile hashes.\n");
+			return 1;
+		}
+	}
 
-	if (num_threads > num_rows)
+	// there is no point in more workers than pieces of work
+	if (num_tiles > 0 && num_threads > num_tiles)
+	{
+		num_threads = num_tiles;
+	}
+	else if (num_tiles == 0 && num_threads > rows)
 	{
-		num_threads = num_rows;
+		num_threads = rows;
 	}
 
 	pthread_t threads[num_threads];
@@ -120,18 +604,34 @@ int main(int argc, char* argv[])
 	msg.iSender = 0;
 	msg.type = RANGE;
 
+	// mailbox mode: the workers' replies for one generation
+	struct msg replies[num_threads];
+
 	int where_are_we = 0;
 	int remainder = rows % num_threads;
 	int num_rows_for_each = (rows - remainder) / num_threads;
 
-	init_boxes(num_threads + 1);
+	num_workers = num_threads;
+	max_generations = num_generations;
+	print_all = print;
+	init_barrier(&gen_barrier, num_threads);
+
+	// every worker replies to box 0 each generation, which has room for all of them so none of them waits on another
+	int capacities[num_threads + 1];
+	capacities[0] = num_threads;
+	for (int i = 1; i <= num_threads; i++)
+	{
+		capacities[i] = 1;
+	}
+	init_boxes(num_threads + 1, capacities);
 
+	clock_gettime(CLOCK_MONOTONIC, &last_gen_end);
 	for (int i = 0; i < num_threads; i++)
 	{
 		int* id = malloc(sizeof(int));
 		*id = i + 1;
 
-		if (pthread_create(&threads[i], NULL, worker_func, id) != 0)
+		if (pthread_create(&threads[i], NULL, sync_mode == SYNC_BARRIER ? barrier_worker_func : worker_func, id) != 0)
 		{
 			printf("Error creating thread.\n");
 			return 1;
@@ -152,79 +652,171 @@ int main(int argc, char* argv[])
 		SendMsg(*id, &msg);
 	}
 
-	int i;
-	for (i = 0; i <= num_generations; i++)
+	long long i;
+	if (sync_mode == SYNC_BARRIER)
 	{
-		int num_same_as_last = 0;
-		int num_all_dead = 0;
-		int num_all_done = 0;
+		// the workers run the generations themselves, all that is left is to show how the game ended
 		for (int j = 0; j < num_threads; j++)
 		{
-			RecvMsg(0, &msg);
-
-			if (msg.type == ALLDONE)
-			{
-				num_all_done++;
-			}
-			else if (msg.type == SAMEASLAST || msg.type == ALLDEADANDSAME)
-			{
-				num_same_as_last++;
-			}
-			else if (msg.type == ALLDEAD || msg.type == ALLDEADANDSAME)
-			{
-				num_all_dead++;
-			}
+			pthread_join(threads[j], NULL);
 		}
 
-		msg.iSender = 0;
+		i = final_gen;
 
-		if (print || i == num_generations || num_same_as_last == num_threads || num_all_done == num_threads)
+		if (i == num_generations || final_same_as_last == num_threads || period > 0)
 		{
-			print_gen(i, i == num_generations || num_same_as_last == num_threads || num_all_done == num_threads);
+			print_gen(i, true);
 		}
-
-		if (num_same_as_last == num_threads || num_all_dead == num_threads || num_all_done == num_threads || i == num_generations)
+		if (i != num_generations && final_all_dead == num_threads)
 		{
-			msg.type = ALLDONE;
-			if (i != num_generations && num_all_dead == num_threads)
-			{
-				print_gen(i + 1, true);
-			}
+			print_gen(i + 1, true);
 		}
-		else
+		if (period > 0)
 		{
-			msg.type = GO;
+			print_cycle();
 		}
-
-		if (num_all_done > 0)
+	}
+	else
+	{
+		for (i = first_gen; i <= num_generations; i++)
 		{
-			if (num_all_done != num_threads)
+			int num_same_as_last = 0;
+			int num_all_dead = 0;
+			int num_all_done = 0;
+			uint64_t hash = 0;
+
+			// whatever replies are already waiting come out together, so the coordinator wakes once for a whole batch of
+			// workers instead of once per worker
+			int received = 0;
+			while (received < num_threads)
 			{
-				printf("Error: some threads are done but others arent.\n");
-				free_boxes(num_threads + 1);
-				return 1;
+				received += RecvMsgBatch(0, replies + received, num_threads - received);
 			}
-		}
-		else
-		{
+
 			for (int j = 0; j < num_threads; j++)
 			{
-				SendMsg(j + 1, &msg);
+				msg = replies[j];
+
+				// each band's hash comes split over the two values
+				hash += (uint32_t) msg.value1 | (uint64_t) (uint32_t) msg.value2 << 32;
+
+				if (msg.type == ALLDONE)
+				{
+					num_all_done++;
+				}
+				else if (msg.type == SAMEASLAST || msg.type == ALLDEADANDSAME)
+				{
+					num_same_as_last++;
+				}
+				else if (msg.type == ALLDEAD || msg.type == ALLDEADANDSAME)
+				{
+					num_all_dead++;
+				}
 			}
 
-			if (msg.type == ALLDONE)
+			msg.iSender = 0;
+
+			bool repeats = detect_cycles && num_all_done == 0 && find_period(i + 1, hash);
+
+			if (print || i == num_generations || num_same_as_last == num_threads || num_all_done == num_threads || repeats)
 			{
-				break;
+				print_gen(i, i == num_generations || num_same_as_last == num_threads || num_all_done == num_threads || repeats);
 			}
+
+			if (save_due(i))
+			{
+				save_gen(i);
+			}
+
+			if (num_same_as_last == num_threads || num_all_dead == num_threads || num_all_done == num_threads || i == num_generations ||
+				repeats)
+			{
+				msg.type = ALLDONE;
+				if (i != num_generations && num_all_dead == num_threads)
+				{
+					print_gen(i + 1, true);
+				}
+				if (repeats)
+				{
+					print_cycle();
+				}
+			}
+			else
+			{
+				msg.type = GO;
+			}
+
+			if (num_all_done > 0)
+			{
+				if (num_all_done != num_threads)
+				{
+					printf("Error: some threads are done but others arent.\n");
+					free_boxes(num_threads + 1);
+					return 1;
+				}
+			}
+			else
+			{
+				// every worker has finished the generation, so no one is using what gets reset
+				reset_generation(&i);
+
+				BroadcastMsg(&msg, num_threads);
+
+				if (msg.type == ALLDONE)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	// the workers always compute one generation past the one being looked at
+	long long generations_computed = i + 1 - first_gen;
+
+	if (sync_mode == SYNC_MAILBOX)
+	{
+		for (int j = 0; j < num_threads; j++)
+		{
+			pthread_join(threads[j], NULL);
 		}
 	}
 
-	for (i = 0; i < num_threads; i++)
+	finish_output();
+
+	clock_gettime(CLOCK_MONOTONIC, &sim_end);
+
+	if (stats)
 	{
-		pthread_join(threads[i], NULL);
+		double sim_ms = elapsed_ms(&sim_start, &sim_end) - print_ms;
+		printf("-->Run Stats<--\n");
+		printf("Grid: %d x %d\n", rows, cols);
+		printf("Rule: %s (%s kernel)\n", rule_name, conway ? "hand-written" : rule_step != NULL ? "specialized" : "runtime");
+		printf("Border: %s\n", border_names[border]);
+		printf("Load Time: %.3fms\n", elapsed_ms(&load_start, &sim_start));
+		printf("Simulation Time: %.3fms\n", sim_ms);
+		printf("Print Time: %.3fms\n", print_ms);
+		printf("Generations Computed: %lld\n", generations_computed);
+		printf("Cells Per Second: %.3g\n", (double) rows * cols * generations_computed / (sim_ms / 1000));
+		printf("Generation Latency: p50 %.1fus, p90 %.1fus, p99 %.1fus\n", histogram_percentile(&gen_latency, 50) / 1000.0,
+			histogram_percentile(&gen_latency, 90) / 1000.0, histogram_percentile(&gen_latency, 99) / 1000.0);
+		printf("Sync Overhead (%s): %.3fus per generation per thread\n", sync_mode == SYNC_BARRIER ? "barrier" : "mailbox",
+			atomic_load(&sync_ns) / 1000.0 / num_threads / generations_computed);
+		if (track_active)
+		{
+			long long skipped = atomic_load(&tiles_skipped);
+			long long total = (long long) num_tiles * generations_computed;
+			printf("Tiles Skipped: %.1f%% (%lld of %lld)\n", 100.0 * skipped / total, skipped, total);
+		}
 	}
 
 	free_boxes(num_threads + 1);
+	free(tiles);
+	free(changed[0]);
+	free(changed[1]);
+	free(tile_alive);
+	free(tile_hash);
+	free_grid(&grids[0]);
+	free_grid(&grids[1]);
 }
 
 void* worker_func(void* id)
@@ -235,94 +827,30 @@ void* worker_func(void* id)
 	int start_row;
 	int end_row;
 
-	bool (*prev)[MAXGRID] = even_grid;
-	bool (*next)[MAXGRID] = odd_grid;
+	grid* prev = &grids[first_gen % 2];
+	grid* next = &grids[(first_gen + 1) % 2];
 
 	start_row = msg.value1;
 	end_row = msg.value2;
 
+	long long waited = 0;
+	long long gen = first_gen;
+
 	do
 	{
-		bool same_as_last = true;
-		bool all_dead = true;
-		for (int i = start_row; i < end_row; i++)
-		{
-			for (int j = 0; j < num_columns; j++)
-			{
-				int num_adj = 0;
-
-				int y = i - 1;
-				int x = j - 1;
-
-				int n = i + 1;
-				int m = j + 1;
-
-				if (i == 0)
-				{
-					y = 0;
-				}
-				else if (i == num_rows - 1)
-				{
-					n = i;
-				}
+		bool same_as_last;
+		bool all_dead;
+		uint64_t hash;
+		compute_share(gen++, prev, next, start_row, end_row, &same_as_last, &all_dead, &hash);
 
-				if (j == 0)
-				{
-					x = 0;
-				}
-				else if (j == num_columns - 1)
-				{
-					m = j;
-				}
-
-				int store = x;
-				for (; y <= n; y++)
-				{
-					for (x = store; x <= m; x++)
-					{
-						if (prev[y][x] && (y != i || x != j))
-						{
-							num_adj++;
-						}
-					}
-				}
-
-				if (prev[i][j])
-				{
-					if (num_adj == 2 || num_adj == 3)
-					{
-						next[i][j] = true;
-					}
-					else
-					{
-						next[i][j] = false;
-					}
-				}
-				else
-				{
-					if (num_adj == 3)
-					{
-						next[i][j] = true;
-					}
-					else
-					{
-						next[i][j] = false;
-					}
-				}
-
-				if (next[i][j])
-				{
-					all_dead = false;
-				}
-				if (prev[i][j] != next[i][j])
-				{
-					same_as_last = false;
-				}
-			}
-		}
+		struct timespec t0;
+		struct timespec t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
 
 		msg.iSender = *(int*) id;
 		msg.type = GENDONE;
+		msg.value1 = (int) (uint32_t) hash;
+		msg.value2 = (int) (uint32_t) (hash >> 32);
 		
 		if (same_as_last)
 		{
@@ -341,62 +869,489 @@ void* worker_func(void* id)
 		}
 
 		SendMsg(0, &msg);
-		RecvMsg(*(int*) id, &msg);
+		RecvBroadcast(*(int*) id, &msg);
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		waited += (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
 
-		bool (*temp)[MAXGRID] = prev;
+		grid* temp = prev;
 		prev = next;
 		next = temp;
 	}
 	while (msg.type == GO);
 
+	atomic_fetch_add(&sync_ns, waited);
+
+	free(id);
+
+	return NULL;
+}
+
+void* barrier_worker_func(void* id)
+{
+	msg msg;
+	RecvMsg(*(int*) id, &msg);
+
+	int start_row = msg.value1;
+	int end_row = msg.value2;
+
+	bool sense = false;
+	long long waited = 0;
+
+	long long i;
+	for (i = first_gen; ; i++)
+	{
+		bool same_as_last;
+		bool all_dead;
+		uint64_t hash;
+		compute_share(i, &grids[i % 2], &grids[(i + 1) % 2], start_row, end_row, &same_as_last, &all_dead, &hash);
+
+		if (detect_cycles)
+		{
+			atomic_fetch_add_explicit(&tallies[i % 2].hash, hash, memory_order_relaxed);
+		}
+
+		if (same_as_last)
+		{
+			atomic_fetch_add_explicit(&tallies[i % 2].same_as_last, 1, memory_order_relaxed);
+		}
+		else if (all_dead)
+		{
+			atomic_fetch_add_explicit(&tallies[i % 2].all_dead, 1, memory_order_relaxed);
+		}
+
+		struct timespec t0;
+		struct timespec t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		barrier_wait(&gen_barrier, &sense, end_generation, &i);
+
+		int num_same_as_last = atomic_load_explicit(&tallies[i % 2].same_as_last, memory_order_relaxed);
+		int num_all_dead = atomic_load_explicit(&tallies[i % 2].all_dead, memory_order_relaxed);
+
+		// the final generations are printed by main once everyone has stopped
+		bool last = i == max_generations || num_same_as_last == num_workers || period > 0;
+		bool done = last || num_all_dead == num_workers;
+
+		bool save = save_due(i);
+
+		if ((print_all && !last) || save)
+		{
+			if (*(int*) id == 1 && print_all && !last)
+			{
+				print_gen(i, false);
+			}
+			if (*(int*) id == 1 && save)
+			{
+				save_gen(i);
+			}
+
+			// generation i is overwritten by the next step, so no one can start it until the writer has its copy
+			if (!done)
+			{
+				barrier_wait(&gen_barrier, &sense, NULL, NULL);
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		waited += (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+
+		if (done)
+		{
+			if (*(int*) id == 1)
+			{
+				final_gen = i;
+				final_same_as_last = num_same_as_last;
+				final_all_dead = num_all_dead;
+			}
+			break;
+		}
+	}
+
+	atomic_fetch_add(&sync_ns, waited);
+
 	free(id);
 
 	return NULL;
 }
 
-void print_gen(int gen_number, bool last)
+void reset_generation(void* gen)
 {
-	if (last)
+	// the next step computes generation gen + 2 from gen + 1
+	long long n = *(long long*) gen + 1;
+
+	atomic_store_explicit(&tallies[n % 2].same_as_last, 0, memory_order_relaxed);
+	atomic_store_explicit(&tallies[n % 2].all_dead, 0, memory_order_relaxed);
+	atomic_store_explicit(&tallies[n % 2].hash, 0, memory_order_relaxed);
+	atomic_store_explicit(&next_tile, 0, memory_order_relaxed);
+
+	fill_border(&grids[n % 2], border);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	histogram_add(&gen_latency, (now.tv_sec - last_gen_end.tv_sec) * 1000000000LL + now.tv_nsec - last_gen_end.tv_nsec);
+	last_gen_end = now;
+
+	if (track_active)
 	{
-		printf("The game ends after %d generations with:\n", gen_number);
+		for (int i = 0; i < (num_tiles + 63) / 64; i++)
+		{
+			atomic_store_explicit(&changed[(n + 1) % 2][i], 0, memory_order_relaxed);
+		}
 	}
-	else
+}
+
+void end_generation(void* gen)
+{
+	long long i = *(long long*) gen;
+
+	if (detect_cycles)
+	{
+		find_period(i + 1, atomic_load_explicit(&tallies[i % 2].hash, memory_order_relaxed));
+	}
+
+	reset_generation(gen);
+}
+
+bool find_period(long long gen, uint64_t hash)
+{
+	// a period of 1 is a still board, which same_as_last already stops on
+	for (int k = 2; k < CYCLE_HISTORY && gen - k >= history_from; k++)
 	{
-		printf("Generation %d:\n", gen_number);
+		if (history[(gen - k) % CYCLE_HISTORY] == hash)
+		{
+			cycle_gen = gen;
+			atomic_store(&period, k);
+			return true;
+		}
 	}
-	for (int i = 0; i < num_rows; i++)
+
+	history[gen % CYCLE_HISTORY] = hash;
+
+	return false;
+}
+
+void print_cycle()
+{
+	// the board the game ended with has to come out first
+	flush_writer();
+	printf("Generation %lld repeats generation %lld, a period of %d.\n", cycle_gen, cycle_gen - period, period);
+}
+
+void compute_share(long long gen, grid* prev, grid* next, int start_row, int end_row, bool* same_as_last, bool* all_dead,
+	uint64_t* hash)
+{
+	*hash = 0;
+
+	if (num_tiles == 0)
 	{
-		for (int j = 0; j < num_columns; j++)
+		step(prev, next, start_row, end_row, 0, prev->words, same_as_last, all_dead);
+		if (detect_cycles)
 		{
-			if (gen_number % 2 == 0)
+			*hash = hash_rect(next, start_row, end_row, 0, next->words);
+		}
+		return;
+	}
+
+	*same_as_last = true;
+	*all_dead = true;
+
+	long long skipped = 0;
+
+	int t;
+	while ((t = atomic_fetch_add_explicit(&next_tile, 1, memory_order_relaxed)) < num_tiles)
+	{
+		bool tile_same_as_last;
+		bool tile_all_dead;
+
+		// nothing is known about the step before the first generation
+		if (track_active && gen > first_gen && !neighbourhood_changed(t, gen))
+		{
+			tile_same_as_last = true;
+			tile_all_dead = !tile_alive[t];
+			skipped++;
+		}
+		else
+		{
+			step(prev, next, tiles[t].start_row, tiles[t].end_row, tiles[t].start_word, tiles[t].end_word, &tile_same_as_last,
+				&tile_all_dead);
+
+			if (detect_cycles)
 			{
-				if (even_grid[i][j])
-				{
-					printf("1 ");
-				}
-				else
+				tile_hash[t] = hash_rect(next, tiles[t].start_row, tiles[t].end_row, tiles[t].start_word, tiles[t].end_word);
+			}
+
+			if (track_active)
+			{
+				tile_alive[t] = !tile_all_dead;
+				if (!tile_same_as_last)
 				{
-					printf("0 ");
+					atomic_fetch_or_explicit(&changed[(gen + 1) % 2][t / 64], (uint64_t) 1 << (t % 64), memory_order_relaxed);
 				}
 			}
+		}
+
+		*same_as_last = *same_as_last && tile_same_as_last;
+		*all_dead = *all_dead && tile_all_dead;
+		if (detect_cycles)
+		{
+			*hash += tile_hash[t];
+		}
+	}
+
+	if (skipped > 0)
+	{
+		atomic_fetch_add_explicit(&tiles_skipped, skipped, memory_order_relaxed);
+	}
+}
+
+bool neighbourhood_changed(int t, long long gen)
+{
+	_Atomic uint64_t* bits = changed[gen % 2];
+
+	int row = t / tiles_across;
+	int col = t % tiles_across;
+	int tiles_down = num_tiles / tiles_across;
+
+	for (int r = row - 1; r <= row + 1; r++)
+	{
+		for (int c = col - 1; c <= col + 1; c++)
+		{
+			// on a torus the tiles along one edge touch the ones along the opposite edge
+			int rr = r;
+			int cc = c;
+			if (border == BORDER_TORUS)
+			{
+				rr = (r + tiles_down) % tiles_down;
+				cc = (c + tiles_across) % tiles_across;
+			}
+			else if (r < 0 || r >= tiles_down || c < 0 || c >= tiles_across)
+			{
+				continue;
+			}
+
+			int n = rr * tiles_across + cc;
+			if ((atomic_load_explicit(&bits[n / 64], memory_order_relaxed) >> (n % 64)) & 1)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int init_active_tracking()
+{
+	int words = (num_tiles + 63) / 64;
+
+	changed[0] = calloc(words, sizeof(uint64_t));
+	changed[1] = calloc(words, sizeof(uint64_t));
+	tile_alive = calloc(num_tiles, sizeof(bool));
+
+	return changed[0] == NULL || changed[1] == NULL || tile_alive == NULL ? -1 : 0;
+}
+
+int make_tiles(int tile_rows, int tile_cols)
+{
+	grid* g = &grids[0];
+	int tile_words = (tile_cols + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+
+	int down = (g->rows + tile_rows - 1) / tile_rows;
+	tiles_across = (g->words + tile_words - 1) / tile_words;
+
+	tiles = malloc(sizeof(tile) * down * tiles_across);
+	if (tiles == NULL)
+	{
+		return -1;
+	}
+
+	num_tiles = 0;
+	for (int r = 0; r < g->rows; r += tile_rows)
+	{
+		for (int w = 0; w < g->words; w += tile_words)
+		{
+			tiles[num_tiles].start_row = r;
+			tiles[num_tiles].end_row = r + tile_rows < g->rows ? r + tile_rows : g->rows;
+			tiles[num_tiles].start_word = w;
+			tiles[num_tiles].end_word = w + tile_words < g->words ? w + tile_words : g->words;
+			num_tiles++;
+		}
+	}
+
+	return 0;
+}
+
+long long run_hashlife(universe* u, long long first, long long num_generations, bool print)
+{
+	if (print)
+	{
+		// every generation is printed anyway, so they are run one at a time just like the workers do
+		node* cur = u->start;
+		for (long long i = first; ; i++)
+		{
+			node* next = hashlife_advance(u, cur, 1);
+			bool last = i == num_generations || next == cur;
+
+			show_hashlife(u, cur, i, last);
+			if (save_due(i))
+			{
+				save_gen(i);
+			}
+
+			if (last)
+			{
+				return i + 1 - first;
+			}
+			else if (!hashlife_alive(next))
+			{
+				show_hashlife(u, next, i + 1, true);
+				return i + 1 - first;
+			}
+
+			cur = next;
+		}
+	}
+
+	// once the game would stop it stays stopped, a still board stays still and an empty one stays empty, so the
+	// generation it stops at can be found with a binary search instead of running every generation
+	long long end = num_generations;
+	long long last_saved = num_generations;
+	long long computed = num_generations - first;
+	if (hashlife_stops(u, hashlife_advance(u, u->start, num_generations - first)))
+	{
+		long long low = first;
+		long long high = num_generations;
+		while (low < high)
+		{
+			long long mid = low + (high - low) / 2;
+			if (hashlife_stops(u, hashlife_advance(u, u->start, mid - first)))
+			{
+				high = mid;
+			}
 			else
 			{
-				if (odd_grid[i][j])
-				{
-					printf("1 ");
-				}
-				else
-				{
-					printf("0 ");
-				}
+				low = mid + 1;
 			}
 		}
 
-		printf("\n");
+		node* stop = hashlife_advance(u, u->start, low - first);
+		node* next = hashlife_advance(u, stop, 1);
+		end = low == num_generations || next == stop ? low : low + 1;
+		last_saved = low;
+		computed = low + 1 - first;
 	}
 
-	if (!last)
+	// the generations -w and -C save are jumped to one after another, then the rest of the way to the end. like when
+	// printing, an empty board that ends the game is not saved. a node from an earlier call can be collected, so only
+	// the one being advanced is kept
+	node* cur = u->start;
+	long long at = first;
+	for (long long i = next_save(first); i <= last_saved; i = next_save(i + 1))
 	{
-		printf("\n");
+		cur = hashlife_advance(u, cur, i - at);
+		at = i;
+		hashlife_to_grid(u, cur, &grids[i % 2]);
+		save_gen(i);
 	}
+
+	show_hashlife(u, hashlife_advance(u, cur, end - at), end, true);
+
+	return computed;
+}
+
+bool hashlife_stops(universe* u, node* gen)
+{
+	node* next = hashlife_advance(u, gen, 1);
+	return next == gen || !hashlife_alive(next);
+}
+
+void show_hashlife(universe* u, node* root, long long gen_number, bool last)
+{
+	hashlife_to_grid(u, root, &grids[gen_number % 2]);
+	print_gen(gen_number, last);
+}
+
+void print_gen(long long gen_number, bool last)
+{
+	if (last && quiet)
+	{
+		return;
+	}
+
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	submit_frame(&grids[gen_number % 2], gen_number, last ? FRAME_LAST : FRAME_PRINT);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_ms += elapsed_ms(&start, &end);
+}
+
+void save_gen(long long gen_number)
+{
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (save_every > 0 && gen_number % save_every == 0)
+	{
+		submit_frame(&grids[gen_number % 2], gen_number, FRAME_SAVE);
+	}
+
+	if (checkpoint_every > 0 && gen_number % checkpoint_every == 0)
+	{
+		checkpoint c;
+		memset(&c, 0, sizeof(c));
+		c.generation = gen_number;
+		c.life_rule = life_rule;
+		c.border = border;
+		c.history_from = detect_cycles ? history_from : -1;
+		memcpy(c.history, history, sizeof(history));
+
+		submit_checkpoint(&grids[gen_number % 2], &c);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_ms += elapsed_ms(&start, &end);
+}
+
+bool save_due(long long gen_number)
+{
+	return (save_every > 0 && gen_number % save_every == 0) || (checkpoint_every > 0 && gen_number % checkpoint_every == 0);
+}
+
+long long next_save(long long gen_number)
+{
+	long long next = LLONG_MAX;
+
+	if (save_every > 0)
+	{
+		next = (gen_number + save_every - 1) / save_every * save_every;
+	}
+	if (checkpoint_every > 0)
+	{
+		long long checkpoint = (gen_number + checkpoint_every - 1) / checkpoint_every * checkpoint_every;
+		next = checkpoint < next ? checkpoint : next;
+	}
+
+	return next;
+}
+
+void finish_output()
+{
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	stop_writer();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_ms += elapsed_ms(&start, &end);
+}
+
+double elapsed_ms(struct timespec* start, struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1e6;
 }
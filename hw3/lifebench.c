@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+#include "rule.h"
+
+#define DEFAULT_DENSITY 50
+
+// the fast kernels are timed this many times and the best run is kept, which takes out most of the noise from anything
+// else running on the machine
+#define REPEATS 5
+
+/*
+ * runs a kernel over a whole board for a number of generations on one thread
+ * params
+ * step: the kernel
+ * start: the first generation, left unchanged
+ * bufs: two boards the same size as start to run the generations in
+ * num_generations: the number of generations to run
+ * border: the border mode, whose ghost cells are filled in after every generation the way life does
+ * returns
+ * the seconds the generations took. the last generation is left in bufs[num_generations % 2]
+*/
+double run_kernel(step_func step, grid* start, grid bufs[2], int num_generations, int border);
+
+/*
+ * run_kernel() REPEATS times
+ * returns
+ * the seconds the fastest run took
+*/
+double best_time(step_func step, grid* start, grid bufs[2], int num_generations, int border);
+
+/*
+ * returns
+ * whether two boards have the same cells
+*/
+bool same_cells(grid* a, grid* b);
+
+// the rules with specialized kernels, each timed against the runtime kernel running the same rule
+static const char* rules[] = {"life", "highlife", "seeds", "daynight"};
+
+// the border modes, each timed against the dead border
+static const char* borders[] = {"dead", "alive", "torus"};
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3 && argc != 4)
+	{
+		printf("Incorrect usage. Proper usage: ./lifebench <size> <num_generations> <OPTIONAL:density(percent)>\n");
+		return 1;
+	}
+
+	int size = atoi(argv[1]);
+	int num_generations = atoi(argv[2]);
+	int density = argc == 4 ? atoi(argv[3]) : DEFAULT_DENSITY;
+
+	if (size <= 0 || num_generations <= 0 || density < 0 || density > 100)
+	{
+		printf("Size and number of generations must be positive integers and density must be between 0 and 100.\n");
+		return 1;
+	}
+
+	grid start;
+	grid simple[2];
+	grid packed[2];
+	if (init_grid(&start, size, size) != 0 || init_grid(&simple[0], size, size) != 0 || init_grid(&simple[1], size, size) != 0 ||
+		init_grid(&packed[0], size, size) != 0 || init_grid(&packed[1], size, size) != 0)
+	{
+		printf("Could not allocate the grid.\n");
+		return 1;
+	}
+
+	srand(1);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = 0; j < size; j++)
+		{
+			set_cell(&start, i, j, rand() % 100 < density);
+		}
+	}
+
+	double simple_time = run_kernel(step_simple, &start, simple, num_generations, BORDER_DEAD);
+	double packed_time = best_time(step_packed, &start, packed, num_generations, BORDER_DEAD);
+
+	bool same = same_cells(&simple[num_generations % 2], &packed[num_generations % 2]);
+
+	double cells = (double) size * size * num_generations;
+
+	printf("-->Kernel Benchmark<-- (%dx%d, %d generations, %d%% alive)\n", size, size, num_generations, density);
+	printf("Simple: %.3fs, %.3g cells/s\n", simple_time, cells / simple_time);
+	printf("Packed: %.3fs, %.3g cells/s\n", packed_time, cells / packed_time);
+	printf("Speedup: %.1fx\n", simple_time / packed_time);
+
+	if (!same)
+	{
+		printf("Error: the kernels disagree after %d generations.\n", num_generations);
+	}
+
+	// the simple buffers are free again, the runtime kernel's generations go there
+	printf("-->Rule Benchmark<-- (relative to the hand-written B3/S23 kernel above)\n");
+	for (int i = 0; i < (int) (sizeof(rules) / sizeof(rules[0])); i++)
+	{
+		rule r;
+		char name[24];
+		parse_rule(rules[i], &r);
+		format_rule(&r, name);
+
+		double specialized_time = best_time(specialized_kernel(&r), &start, packed, num_generations, BORDER_DEAD);
+		double runtime_time = best_time(runtime_kernel(&r), &start, simple, num_generations, BORDER_DEAD);
+
+		printf("%s: specialized %.3fs, %.3g cells/s, %.0f%% | runtime %.3fs, %.3g cells/s, %.0f%%\n", name, specialized_time,
+			cells / specialized_time, 100 * packed_time / specialized_time, runtime_time, cells / runtime_time,
+			100 * packed_time / runtime_time);
+
+		if (!same_cells(&simple[num_generations % 2], &packed[num_generations % 2]))
+		{
+			printf("Error: the %s kernels disagree after %d generations.\n", name, num_generations);
+			same = false;
+		}
+	}
+
+	// the runtime kernel running B3/S23 checks the packed one, both reading the same ghost cells
+	printf("-->Border Benchmark<-- (relative to the dead border)\n");
+	rule conway;
+	parse_rule("life", &conway);
+	for (int i = 0; i < (int) (sizeof(borders) / sizeof(borders[0])); i++)
+	{
+		int border = find_border(borders[i]);
+
+		double border_time = best_time(step_packed, &start, packed, num_generations, border);
+		run_kernel(runtime_kernel(&conway), &start, simple, num_generations, border);
+
+		printf("%s: %.3fs, %.3g cells/s, %.0f%%\n", borders[i], border_time, cells / border_time,
+			100 * packed_time / border_time);
+
+		if (!same_cells(&simple[num_generations % 2], &packed[num_generations % 2]))
+		{
+			printf("Error: the kernels disagree with the %s border after %d generations.\n", borders[i], num_generations);
+			same = false;
+		}
+	}
+
+	free_grid(&start);
+	for (int i = 0; i < 2; i++)
+	{
+		free_grid(&simple[i]);
+		free_grid(&packed[i]);
+	}
+
+	return same ? 0 : 1;
+}
+
+double run_kernel(step_func step, grid* start, grid bufs[2], int num_generations, int border)
+{
+	// both buffers, so no ghost cells are left over from a run with another border
+	size_t size = (size_t) (start->rows + 2) * start->stride * sizeof(uint64_t);
+	memcpy(bufs[0].cells, start->cells, size);
+	memcpy(bufs[1].cells, start->cells, size);
+	fill_border(&bufs[0], border);
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = 0; i < num_generations; i++)
+	{
+		bool same_as_last;
+		bool all_dead;
+		step(&bufs[i % 2], &bufs[(i + 1) % 2], 0, start->rows, 0, start->words, &same_as_last, &all_dead);
+		fill_border(&bufs[(i + 1) % 2], border);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+double best_time(step_func step, grid* start, grid bufs[2], int num_generations, int border)
+{
+	double best = run_kernel(step, start, bufs, num_generations, border);
+	for (int i = 1; i < REPEATS; i++)
+	{
+		double t = run_kernel(step, start, bufs, num_generations, border);
+		best = t < best ? t : best;
+	}
+
+	return best;
+}
+
+bool same_cells(grid* a, grid* b)
+{
+	for (int i = 0; i < a->rows; i++)
+	{
+		if (memcmp(grid_row(a, i), grid_row(b, i), a->words * sizeof(uint64_t)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
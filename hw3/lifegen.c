@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+#include "pattern.h"
+
+#define DEFAULT_DENSITY 50
+
+// the known patterns, a row to a string with O for alive
+static const char* r_pentomino[] =
+{
+	".OO",
+	"OO.",
+	".O.",
+	NULL
+};
+
+static const char* gosper_gun[] =
+{
+	"........................O...........",
+	"......................O.O...........",
+	"............OO......OO............OO",
+	"...........O...O....OO............OO",
+	"OO........O.....O...OO..............",
+	"OO........O...O.OO....O.O...........",
+	"..........O.....O.......O...........",
+	"...........O...O....................",
+	"............OO......................",
+	NULL
+};
+
+/*
+ * sets the live cells of a pattern on a board
+ * params
+ * g: the board
+ * pattern: the pattern's rows
+ * row: the board row its top row goes on
+ * col: the board column its left column goes on
+ * returns
+ * 0 on success, -1 if it does not fit
+*/
+int place(grid* g, const char** pattern, int row, int col);
+
+int main(int argc, char* argv[])
+{
+	if (argc != 4 && argc != 5)
+	{
+		printf("Incorrect usage. Proper usage: ./lifegen <rpentomino|gun|random> <size> <filename> <OPTIONAL:density(percent)>\n");
+		return 1;
+	}
+
+	int size = atoi(argv[2]);
+	int density = argc == 5 ? atoi(argv[4]) : DEFAULT_DENSITY;
+
+	if (size <= 0 || density < 0 || density > 100)
+	{
+		printf("Size must be a positive integer and density must be between 0 and 100.\n");
+		return 1;
+	}
+
+	grid g;
+	if (init_grid(&g, size, size) != 0)
+	{
+		printf("Could not allocate the grid.\n");
+		return 1;
+	}
+
+	int ret = 0;
+	char comment[64];
+	if (!strcmp(argv[1], "rpentomino"))
+	{
+		// in the middle, where it has the most room to grow before it reaches an edge
+		ret = place(&g, r_pentomino, size / 2 - 1, size / 2 - 1);
+		snprintf(comment, sizeof(comment), "R-pentomino on %dx%d", size, size);
+	}
+	else if (!strcmp(argv[1], "gun"))
+	{
+		// in the top left corner, so its gliders cross the whole board on their way to the bottom right
+		ret = place(&g, gosper_gun, 1, 1);
+		snprintf(comment, sizeof(comment), "Gosper glider gun on %dx%d", size, size);
+	}
+	else if (!strcmp(argv[1], "random"))
+	{
+		srand(1);
+		for (int i = 0; i < size; i++)
+		{
+			for (int j = 0; j < size; j++)
+			{
+				set_cell(&g, i, j, rand() % 100 < density);
+			}
+		}
+		snprintf(comment, sizeof(comment), "%d%% random on %dx%d", density, size, size);
+	}
+	else
+	{
+		printf("Unknown pattern %s, it must be rpentomino, gun or random.\n", argv[1]);
+		ret = -1;
+	}
+
+	if (ret == 0)
+	{
+		ret = save_pattern(argv[3], &g, comment, "B3/S23");
+	}
+
+	free_grid(&g);
+
+	return ret == 0 ? 0 : 1;
+}
+
+int place(grid* g, const char** pattern, int row, int col)
+{
+	for (int i = 0; pattern[i] != NULL; i++)
+	{
+		for (int j = 0; pattern[i][j] != '\0'; j++)
+		{
+			if (row + i >= g->rows || col + j >= g->cols)
+			{
+				printf("The pattern does not fit on a %dx%d board.\n", g->rows, g->cols);
+				return -1;
+			}
+
+			set_cell(g, row + i, col + j, pattern[i][j] == 'O');
+		}
+	}
+
+	return 0;
+}
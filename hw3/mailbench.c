@@ -0,0 +1,701 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "mailbox.h"
+#include "histogram.h"
+
+#define DEFAULT_CAPACITY 64
+
+// each setup is timed this many times and the best run is kept, which takes out most of the noise from anything else
+// running on the machine
+#define REPEATS 5
+
+#define MAXTHREAD 1024
+
+// the largest box the benchmarks are run with, the receiver keeps a buffer this many messages long
+#define MAX_CAPACITY (1 << 20)
+
+// how long RecvMsgTimeout() is asked to wait on a box nothing is sent to, and how far past that it may return
+#define TIMEOUT_US 20000
+#define TIMEOUT_SLACK_US 50000
+
+// how long the receiver waits for each message when the senders never block
+#define POLL_US 1000
+
+// the ping-pong benchmark goes from one pair of threads up to this many
+#define MAX_PAIRS 32
+
+// the messages a batched sender hands over at a time
+#define BATCH 16
+
+// the coordination benchmark's message types, the way life uses them
+#define COORD_GO 0
+#define COORD_DONE 1
+#define COORD_ALLDONE 2
+
+// the spin budgets the handoff latency is measured with, the first one sleeps straight away
+static const int spin_budgets[] = {0, 100, 1000, 10000};
+
+typedef struct sender_args
+{
+	int id;
+	int num_messages;
+
+	// send with TrySendMsg(), retrying whenever the box is full, and count the retries in full
+	bool try_send;
+	long long full;
+
+	// send with SendMsgBatch(), this many messages at a time
+	int batch;
+} sender_args;
+
+/*
+ * sends num_messages messages to box 0, numbered from 0 in value1
+*/
+void* sender_func(void* arg);
+
+/*
+ * has num_senders threads send num_messages messages each to box 0 while main receives them all
+ * params
+ * num_senders: the number of sending threads
+ * num_messages: the number each of them sends
+ * capacity: how many messages box 0 holds
+ * batch: if more than 1, the senders send this many at a time with SendMsgBatch() and main receives with RecvMsgBatch()
+ * in_order: set to false if any sender's messages arrived out of order
+ * returns
+ * the seconds from starting the senders to receiving the last message
+*/
+double many_to_one(int num_senders, int num_messages, int capacity, int batch, bool* in_order);
+
+/*
+ * many_to_one() REPEATS times
+ * returns
+ * the seconds the fastest run took
+*/
+double best_many_to_one(int num_senders, int num_messages, int capacity, int batch, bool* in_order);
+
+/*
+ * has num_senders threads send num_messages messages each to box 0 with TrySendMsg(), while main receives them with
+ * RecvMsgTimeout()
+ * params
+ * full: set to how many times a sender found the box full
+ * timeouts: set to how many times main waited POLL_US without a message
+ * in_order: set to false if any sender's messages arrived out of order
+ * returns
+ * the seconds from starting the senders to receiving the last message
+*/
+double try_many_to_one(int num_senders, int num_messages, int capacity, long long* full, long long* timeouts, bool* in_order);
+
+typedef struct player_args
+{
+	// the box the player receives from, and the one the other player in its pair receives from
+	int box;
+	int partner;
+
+	int rounds;
+
+	// whether this player sends first
+	bool serves;
+
+	// where the server adds how long each round trip took, in nanoseconds, if it is not NULL
+	histogram* round_trips;
+} player_args;
+
+/*
+ * plays ping-pong with its partner, passing one message back and forth rounds times
+*/
+void* player_func(void* arg);
+
+/*
+ * has pairs of threads ping-pong through neighbouring boxes, pair p through boxes 2p and 2p + 1, so that if neighbouring
+ * boxes share a cache line the pairs fight over it
+ * params
+ * num_pairs: the number of pairs
+ * rounds: how many round trips each pair makes
+ * round_trips: where the first pair's round trips are timed, or NULL
+ * returns
+ * the seconds from starting the pairs until they have all finished
+*/
+double ping_pong(int num_pairs, int rounds, histogram* round_trips);
+
+typedef struct worker_args
+{
+	// the box the worker receives from
+	int box;
+
+	// take GO and ALLDONE with RecvBroadcast() rather than from the box
+	bool batched;
+} worker_args;
+
+/*
+ * waits for GO, answering each with a DONE to box 0, until ALLDONE comes
+*/
+void* worker_func(void* arg);
+
+/*
+ * runs generations the way life's coordinator does with -m mailbox: GO to every worker, then a DONE back from each
+ * params
+ * num_workers: the number of workers, which receive from boxes 1 to num_workers
+ * generations: the number of generations
+ * batched: send GO and ALLDONE with BroadcastMsg() and collect the DONEs with RecvMsgBatch(), rather than a box at a time
+ * returns
+ * the seconds the generations took
+*/
+double coordinate(int num_workers, int generations, bool batched);
+
+/*
+ * checks what the non-blocking calls return on an empty and a full box
+ * returns
+ * whether they all returned what they should
+*/
+bool check_statuses();
+
+/*
+ * returns
+ * the seconds between two times
+*/
+double seconds(struct timespec* start, struct timespec* end);
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3 && argc != 4)
+	{
+		printf("Incorrect usage. Proper usage: ./mailbench <num_senders> <num_messages> <OPTIONAL:capacity>\n");
+		return 1;
+	}
+
+	int num_senders = atoi(argv[1]);
+	int num_messages = atoi(argv[2]);
+	int capacity = argc == 4 ? atoi(argv[3]) : DEFAULT_CAPACITY;
+
+	if (num_senders <= 0 || num_messages <= 0 || capacity <= 0)
+	{
+		printf("Number of senders, number of messages and capacity must be positive integers.\n");
+		return 1;
+	}
+
+	if (num_senders > MAXTHREAD)
+	{
+		printf("Number of senders cannot exceed %d.\n", MAXTHREAD);
+		return 1;
+	}
+
+	if (capacity > MAX_CAPACITY)
+	{
+		printf("Capacity cannot exceed %d.\n", MAX_CAPACITY);
+		return 1;
+	}
+
+	bool in_order = true;
+	double messages = (double) num_senders * num_messages;
+
+	// a box with room for one message is how every box worked before they had a capacity
+	double single_time = best_many_to_one(num_senders, num_messages, 1, 1, &in_order);
+	double ring_time = best_many_to_one(num_senders, num_messages, capacity, 1, &in_order);
+	double batch_time = best_many_to_one(num_senders, num_messages, capacity, BATCH, &in_order);
+
+	printf("-->Many-to-One Benchmark<-- (%d senders, %d messages each)\n", num_senders, num_messages);
+	printf("Capacity 1: %.3fs, %.3g messages/s\n", single_time, messages / single_time);
+	printf("Capacity %d: %.3fs, %.3g messages/s\n", capacity, ring_time, messages / ring_time);
+	printf("Capacity %d, batches of %d: %.3fs, %.3g messages/s\n", capacity, BATCH, batch_time, messages / batch_time);
+	printf("Speedup: %.1fx, %.1fx batched\n", single_time / ring_time, single_time / batch_time);
+
+	printf("-->Non-Blocking Benchmark<-- (TrySendMsg senders, RecvMsgTimeout receiver)\n");
+
+	bool statuses_ok = check_statuses();
+
+	// nothing is ever sent to this box, so the wait runs its course
+	init_boxes(1, NULL);
+	msg msg;
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	int status = RecvMsgTimeout(0, &msg, TIMEOUT_US);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	free_boxes(1);
+
+	double waited_us = seconds(&t0, &t1) * 1e6;
+	bool timeout_ok = status == MAILBOX_TIMEOUT && waited_us >= TIMEOUT_US && waited_us < TIMEOUT_US + TIMEOUT_SLACK_US;
+	printf("Timeout: asked for %.1fms, waited %.1fms\n", TIMEOUT_US / 1000.0, waited_us / 1000);
+
+	long long full = 0;
+	long long timeouts = 0;
+	double try_time = try_many_to_one(num_senders, num_messages, capacity, &full, &timeouts, &in_order);
+	printf("Capacity %d: %.3fs, %.3g messages/s, %lld sends found it full, %lld receives timed out\n", capacity, try_time,
+		messages / try_time, full, timeouts);
+
+	// the same number of round trips in total at every thread count
+	printf("-->Ping-Pong Benchmark<-- (%d round trips split over the pairs)\n", num_messages);
+	for (int pairs = 1; pairs <= MAX_PAIRS; pairs *= 2)
+	{
+		int rounds = num_messages / pairs > 0 ? num_messages / pairs : 1;
+		double ping_time = ping_pong(pairs, rounds, NULL);
+		printf("%d threads: %.3fs, %.3g round trips/s\n", pairs * 2, ping_time, (double) pairs * rounds / ping_time);
+	}
+
+	// a generation is the coordinator's round of GO and DONE with every worker, with no work in between
+	int generations = num_messages / num_senders > 0 ? num_messages / num_senders : 1;
+	double one_time = coordinate(num_senders, generations, false);
+	double batched_time = coordinate(num_senders, generations, true);
+	printf("-->Coordination Benchmark<-- (%d workers, %d generations)\n", num_senders, generations);
+	printf("A box at a time: %.2fus per generation\n", one_time / generations * 1e6);
+	printf("Broadcast and batched: %.2fus per generation\n", batched_time / generations * 1e6);
+	printf("Speedup: %.1fx\n", one_time / batched_time);
+
+	// a handoff is one message getting from one thread to the other, half a round trip
+	printf("-->Handoff Latency Benchmark<-- (%s, one pair, %d round trips)\n", wait_strategy(), num_messages);
+	for (int i = 0; i < (int) (sizeof(spin_budgets) / sizeof(spin_budgets[0])); i++)
+	{
+		static histogram round_trips;
+		memset(&round_trips, 0, sizeof(round_trips));
+
+		set_spin_budget(spin_budgets[i]);
+		ping_pong(1, num_messages, &round_trips);
+
+		double p50 = histogram_percentile(&round_trips, 50) / 2000.0;
+		double p99 = histogram_percentile(&round_trips, 99) / 2000.0;
+
+		// semaphores never spin, the budget makes no difference to them
+		if (!strcmp(wait_strategy(), "semaphores"))
+		{
+			printf("Semaphores: p50 %.2fus, p99 %.2fus\n", p50, p99);
+			break;
+		}
+		printf("Spin %d: p50 %.2fus, p99 %.2fus\n", spin_budgets[i], p50, p99);
+	}
+
+	if (!statuses_ok)
+	{
+		printf("Error: a non-blocking call returned the wrong status.\n");
+	}
+	if (!timeout_ok)
+	{
+		printf("Error: RecvMsgTimeout() did not time out after %dus.\n", TIMEOUT_US);
+	}
+	if (!in_order)
+	{
+		printf("Error: messages from a sender arrived out of order or went missing.\n");
+	}
+
+	return in_order && statuses_ok && timeout_ok ? 0 : 1;
+}
+
+void* sender_func(void* arg)
+{
+	sender_args* args = arg;
+
+	msg msg;
+	msg.iSender = args->id;
+	msg.type = 0;
+	msg.value2 = 0;
+
+	if (args->batch > 1)
+	{
+		struct msg batch[args->batch];
+		for (int i = 0; i < args->num_messages; i += args->batch)
+		{
+			int count = args->num_messages - i < args->batch ? args->num_messages - i : args->batch;
+			for (int j = 0; j < count; j++)
+			{
+				batch[j] = msg;
+				batch[j].value1 = i + j;
+			}
+			SendMsgBatch(0, batch, count);
+		}
+
+		return NULL;
+	}
+
+	for (int i = 0; i < args->num_messages; i++)
+	{
+		msg.value1 = i;
+
+		if (!args->try_send)
+		{
+			SendMsg(0, &msg);
+			continue;
+		}
+
+		while (TrySendMsg(0, &msg) == MAILBOX_FULL)
+		{
+			args->full++;
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+double many_to_one(int num_senders, int num_messages, int capacity, int batch, bool* in_order)
+{
+	pthread_t threads[num_senders];
+	sender_args args[num_senders];
+	int expected[num_senders];
+	memset(expected, 0, sizeof(expected));
+
+	msg* received = malloc(sizeof(msg) * capacity);
+	if (received == NULL)
+	{
+		printf("Could not allocate the receive buffer.\n");
+		exit(1);
+	}
+
+	init_boxes(1, &capacity);
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = 0; i < num_senders; i++)
+	{
+		args[i].id = i;
+		args[i].num_messages = num_messages;
+		args[i].try_send = false;
+		args[i].full = 0;
+		args[i].batch = batch;
+		if (pthread_create(&threads[i], NULL, sender_func, &args[i]) != 0)
+		{
+			printf("Error creating thread.\n");
+			exit(1);
+		}
+	}
+
+	// every sender's messages have to come out in the order it sent them, whatever happens between senders
+	long long total = (long long) num_senders * num_messages;
+	for (long long i = 0; i < total;)
+	{
+		int n = 1;
+		if (batch > 1)
+		{
+			n = RecvMsgBatch(0, received, capacity);
+		}
+		else
+		{
+			RecvMsg(0, &received[0]);
+		}
+
+		for (int j = 0; j < n; j++)
+		{
+			msg* m = &received[j];
+			if (m->iSender < 0 || m->iSender >= num_senders || m->value1 != expected[m->iSender]++)
+			{
+				*in_order = false;
+			}
+		}
+		i += n;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	for (int i = 0; i < num_senders; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	free_boxes(1);
+	free(received);
+
+	return seconds(&t0, &t1);
+}
+
+double best_many_to_one(int num_senders, int num_messages, int capacity, int batch, bool* in_order)
+{
+	double best = many_to_one(num_senders, num_messages, capacity, batch, in_order);
+	for (int i = 1; i < REPEATS; i++)
+	{
+		double t = many_to_one(num_senders, num_messages, capacity, batch, in_order);
+		best = t < best ? t : best;
+	}
+
+	return best;
+}
+
+double try_many_to_one(int num_senders, int num_messages, int capacity, long long* full, long long* timeouts, bool* in_order)
+{
+	pthread_t threads[num_senders];
+	sender_args args[num_senders];
+	int expected[num_senders];
+	memset(expected, 0, sizeof(expected));
+
+	init_boxes(1, &capacity);
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = 0; i < num_senders; i++)
+	{
+		args[i].id = i;
+		args[i].num_messages = num_messages;
+		args[i].try_send = true;
+		args[i].full = 0;
+		args[i].batch = 1;
+		if (pthread_create(&threads[i], NULL, sender_func, &args[i]) != 0)
+		{
+			printf("Error creating thread.\n");
+			exit(1);
+		}
+	}
+
+	long long received = 0;
+	while (received < (long long) num_senders * num_messages)
+	{
+		msg msg;
+		if (RecvMsgTimeout(0, &msg, POLL_US) == MAILBOX_TIMEOUT)
+		{
+			(*timeouts)++;
+			continue;
+		}
+
+		if (msg.iSender < 0 || msg.iSender >= num_senders || msg.value1 != expected[msg.iSender]++)
+		{
+			*in_order = false;
+		}
+		received++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	for (int i = 0; i < num_senders; i++)
+	{
+		pthread_join(threads[i], NULL);
+		*full += args[i].full;
+	}
+
+	// everything sent was received, so there is nothing left
+	msg msg;
+	if (TryRecvMsg(0, &msg) != MAILBOX_EMPTY)
+	{
+		*in_order = false;
+	}
+
+	free_boxes(1);
+
+	return seconds(&t0, &t1);
+}
+
+bool check_statuses()
+{
+	int capacity = 2;
+	init_boxes(1, &capacity);
+
+	msg msg = {0, 0, 0, 0};
+	msg.value1 = 1;
+	bool ok = TryRecvMsg(0, &msg) == MAILBOX_EMPTY && RecvMsgTimeout(0, &msg, 0) == MAILBOX_TIMEOUT && msg.value1 == 1;
+
+	// the box fills up after two, and takes a third once one has been received
+	ok = ok && TrySendMsg(0, &msg) == MAILBOX_OK;
+	msg.value1 = 2;
+	ok = ok && TrySendMsg(0, &msg) == MAILBOX_OK && TrySendMsg(0, &msg) == MAILBOX_FULL;
+	ok = ok && TryRecvMsg(0, &msg) == MAILBOX_OK && msg.value1 == 1;
+	msg.value1 = 3;
+	ok = ok && TrySendMsg(0, &msg) == MAILBOX_OK;
+	ok = ok && RecvMsgTimeout(0, &msg, TIMEOUT_US) == MAILBOX_OK && msg.value1 == 2;
+	ok = ok && RecvMsgTimeout(0, &msg, 0) == MAILBOX_OK && msg.value1 == 3;
+	ok = ok && TryRecvMsg(0, &msg) == MAILBOX_EMPTY;
+
+	free_boxes(1);
+
+	return ok;
+}
+
+double seconds(struct timespec* start, struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void* player_func(void* arg)
+{
+	player_args* args = arg;
+
+	msg msg;
+	msg.iSender = args->box;
+	msg.type = 0;
+	msg.value1 = 0;
+	msg.value2 = 0;
+
+	struct timespec sent;
+	struct timespec received;
+
+	if (args->serves)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &sent);
+		SendMsg(args->partner, &msg);
+	}
+
+	for (int i = 0; i < args->rounds; i++)
+	{
+		RecvMsg(args->box, &msg);
+
+		if (args->serves && args->round_trips != NULL)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &received);
+			histogram_add(args->round_trips, (received.tv_sec - sent.tv_sec) * 1000000000LL + received.tv_nsec - sent.tv_nsec);
+		}
+
+		// the server's last receive ends the game, nothing goes back
+		if (!args->serves || i < args->rounds - 1)
+		{
+			msg.iSender = args->box;
+			clock_gettime(CLOCK_MONOTONIC, &sent);
+			SendMsg(args->partner, &msg);
+		}
+	}
+
+	return NULL;
+}
+
+double ping_pong(int num_pairs, int rounds, histogram* round_trips)
+{
+	pthread_t threads[num_pairs * 2];
+	player_args args[num_pairs * 2];
+
+	init_boxes(num_pairs * 2, NULL);
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = 0; i < num_pairs * 2; i++)
+	{
+		args[i].box = i;
+		args[i].partner = i ^ 1;
+		args[i].rounds = rounds;
+		args[i].serves = i % 2 == 0;
+		args[i].round_trips = i == 0 ? round_trips : NULL;
+		if (pthread_create(&threads[i], NULL, player_func, &args[i]) != 0)
+		{
+			printf("Error creating thread.\n");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < num_pairs * 2; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	free_boxes(num_pairs * 2);
+
+	return seconds(&t0, &t1);
+}
+
+void* worker_func(void* arg)
+{
+	worker_args* args = arg;
+	int box = args->box;
+
+	msg msg;
+	while (true)
+	{
+		if (args->batched)
+		{
+			RecvBroadcast(box, &msg);
+		}
+		else
+		{
+			RecvMsg(box, &msg);
+		}
+
+		if (msg.type == COORD_ALLDONE)
+		{
+			break;
+		}
+
+		msg.iSender = box;
+		msg.type = COORD_DONE;
+		SendMsg(0, &msg);
+	}
+
+	return NULL;
+}
+
+double coordinate(int num_workers, int generations, bool batched)
+{
+	pthread_t threads[num_workers];
+	worker_args args[num_workers];
+
+	// every DONE of a generation fits in box 0 at once, each worker only ever has one message waiting
+	int capacities[num_workers + 1];
+	capacities[0] = num_workers;
+	for (int i = 1; i <= num_workers; i++)
+	{
+		capacities[i] = 1;
+	}
+	init_boxes(num_workers + 1, capacities);
+
+	for (int i = 0; i < num_workers; i++)
+	{
+		args[i].box = i + 1;
+		args[i].batched = batched;
+		if (pthread_create(&threads[i], NULL, worker_func, &args[i]) != 0)
+		{
+			printf("Error creating thread.\n");
+			exit(1);
+		}
+	}
+
+	msg msg;
+	msg.iSender = 0;
+	msg.value1 = 0;
+	msg.value2 = 0;
+	struct msg replies[num_workers];
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int g = 0; g < generations; g++)
+	{
+		msg.type = COORD_GO;
+
+		if (batched)
+		{
+			BroadcastMsg(&msg, num_workers);
+			for (int received = 0; received < num_workers;)
+			{
+				received += RecvMsgBatch(0, replies + received, num_workers - received);
+			}
+			continue;
+		}
+
+		for (int i = 1; i <= num_workers; i++)
+		{
+			SendMsg(i, &msg);
+		}
+		for (int i = 0; i < num_workers; i++)
+		{
+			RecvMsg(0, &replies[i]);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	msg.type = COORD_ALLDONE;
+	if (batched)
+	{
+		BroadcastMsg(&msg, num_workers);
+	}
+	else
+	{
+		for (int i = 1; i <= num_workers; i++)
+		{
+			SendMsg(i, &msg);
+		}
+	}
+
+	for (int i = 0; i < num_workers; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	free_boxes(num_workers + 1);
+
+	return seconds(&t0, &t1);
+}
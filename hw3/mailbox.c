@@ -1,65 +1,649 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "mailbox.h"
 
-#define READY_FOR_WRITE 0
-#define READY_FOR_READ 1
+// how many times a blocked send or receive checks again before it sleeps, when there is more than one cpu
+#define DEFAULT_SPIN_BUDGET 1000
 
-msg** boxes;
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
 
-sem_t** sems;
+// set by set_spin_budget(), or by init_boxes() to the default if it never was
+static int spin_budget = -1;
 
-void init_boxes(int num_boxes)
+#ifdef MAILBOX_SEMAPHORES
+
+// building with -DMAILBOX_SEMAPHORES counts with POSIX semaphores instead, which go straight to sleep, to compare against
+typedef sem_t counter;
+
+static void counter_init(counter* c, int value)
+{
+	if (sem_init(c, 0, value) != 0)
+	{
+		printf("Could not init semaphore\n");
+	}
+}
+
+static void counter_destroy(counter* c)
+{
+	sem_destroy(c);
+}
+
+static int counter_trytake(counter* c, int max)
+{
+	int taken = 0;
+	while (taken < max && sem_trywait(c) == 0)
+	{
+		taken++;
+	}
+
+	return taken;
+}
+
+static bool counter_timedwait(counter* c, long long timeout_us)
+{
+	if (timeout_us < 0)
+	{
+		while (sem_wait(c) != 0)
+		{
+			// only a signal stops sem_wait() early
+		}
+		return true;
+	}
+
+	// sem_timedwait() wants the time to give up at on the realtime clock
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_us / 1000000;
+	deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	int ret;
+	while ((ret = sem_timedwait(c, &deadline)) != 0 && errno == EINTR)
+	{
+		// a signal is not a timeout, keep waiting
+	}
+
+	return ret == 0;
+}
+
+static void counter_post(counter* c, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		sem_post(c);
+	}
+}
+
+/*
+ * a number that goes up by one with every broadcast, which any number of threads wait on. semaphores cannot wake every
+ * waiter at once, so this build uses a condition variable
+*/
+typedef struct sequence
+{
+	unsigned value;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} sequence;
+
+static void sequence_init(sequence* s)
+{
+	s->value = 0;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->changed, NULL);
+}
+
+static void sequence_destroy(sequence* s)
+{
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->changed);
+}
+
+/*
+ * waits until the value is no longer seen
+ * returns
+ * the new value
+*/
+static unsigned sequence_wait(sequence* s, unsigned seen)
+{
+	pthread_mutex_lock(&s->lock);
+	while (s->value == seen)
+	{
+		pthread_cond_wait(&s->changed, &s->lock);
+	}
+	unsigned value = s->value;
+	pthread_mutex_unlock(&s->lock);
+
+	return value;
+}
+
+static void sequence_publish(sequence* s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->value++;
+	pthread_cond_broadcast(&s->changed);
+	pthread_mutex_unlock(&s->lock);
+}
+
+const char* wait_strategy()
+{
+	return "semaphores";
+}
+
+#else
+
+/*
+ * a counting semaphore that spins before it sleeps. a thread that finds it at 0 checks again spin_budget times with a
+ * pause in between, which catches a peer on another cpu that is about to post without either of them entering the
+ * kernel. only then does it sleep on a futex on count. sleepers counts the threads asleep or about to be, so a post only
+ * makes a system call when there is someone to wake
+*/
+typedef struct counter
+{
+	_Atomic int count;
+	_Atomic int sleepers;
+} counter;
+
+static void counter_init(counter* c, int value)
+{
+	atomic_init(&c->count, value);
+	atomic_init(&c->sleepers, 0);
+}
+
+static void counter_destroy(counter* c)
 {
-	boxes = malloc(sizeof(msg*) * num_boxes);
-	sems = malloc(sizeof(sem_t*) * num_boxes);
+	(void) c;
+}
+
+static int counter_trytake(counter* c, int max)
+{
+	int value = atomic_load_explicit(&c->count, memory_order_relaxed);
+	while (value > 0)
+	{
+		int taken = value < max ? value : max;
+		if (atomic_compare_exchange_weak_explicit(&c->count, &value, value - taken, memory_order_acquire,
+			memory_order_relaxed))
+		{
+			return taken;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * takes one from the count, waiting forever if timeout_us is negative
+ * returns
+ * whether it took one before the timeout
+*/
+static bool counter_timedwait(counter* c, long long timeout_us)
+{
+	if (counter_trytake(c, 1) == 1)
+	{
+		return true;
+	}
+
+	for (int i = 0; i < spin_budget; i++)
+	{
+		if (atomic_load_explicit(&c->count, memory_order_relaxed) > 0 && counter_trytake(c, 1) == 1)
+		{
+			return true;
+		}
+		cpu_relax();
+	}
+
+	struct timespec deadline;
+	if (timeout_us >= 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_us / 1000000;
+		deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	// once it has said it is going to sleep, either it sees the next post or the poster sees it and wakes it
+	atomic_fetch_add_explicit(&c->sleepers, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	bool taken;
+	while (!(taken = counter_trytake(c, 1) == 1))
+	{
+		struct timespec left;
+		if (timeout_us >= 0)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			long long ns = (deadline.tv_sec - now.tv_sec) * 1000000000LL + deadline.tv_nsec - now.tv_nsec;
+			if (ns <= 0)
+			{
+				break;
+			}
+			left.tv_sec = ns / 1000000000;
+			left.tv_nsec = ns % 1000000000;
+		}
+
+		// returns straight away if count is no longer 0, and early on a signal, either way it is checked again
+		syscall(SYS_futex, &c->count, FUTEX_WAIT_PRIVATE, 0, timeout_us >= 0 ? &left : NULL, NULL, 0);
+	}
+
+	atomic_fetch_sub_explicit(&c->sleepers, 1, memory_order_relaxed);
+
+	return taken;
+}
+
+static void counter_post(counter* c, int n)
+{
+	atomic_fetch_add_explicit(&c->count, n, memory_order_release);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (atomic_load_explicit(&c->sleepers, memory_order_relaxed) > 0)
+	{
+		syscall(SYS_futex, &c->count, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+	}
+}
+
+/*
+ * a number that goes up by one with every broadcast, which any number of threads wait on. waiters spin on it the way
+ * counters do before they sleep on a futex on it, and a publish wakes every sleeper with one system call
+*/
+typedef struct sequence
+{
+	_Atomic unsigned value;
+	_Atomic int sleepers;
+} sequence;
+
+static void sequence_init(sequence* s)
+{
+	atomic_init(&s->value, 0);
+	atomic_init(&s->sleepers, 0);
+}
+
+static void sequence_destroy(sequence* s)
+{
+	(void) s;
+}
+
+/*
+ * waits until the value is no longer seen
+ * returns
+ * the new value
+*/
+static unsigned sequence_wait(sequence* s, unsigned seen)
+{
+	unsigned value;
+	for (int i = 0; i < spin_budget; i++)
+	{
+		if ((value = atomic_load_explicit(&s->value, memory_order_acquire)) != seen)
+		{
+			return value;
+		}
+		cpu_relax();
+	}
+
+	atomic_fetch_add_explicit(&s->sleepers, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	while ((value = atomic_load_explicit(&s->value, memory_order_acquire)) == seen)
+	{
+		syscall(SYS_futex, &s->value, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+	}
+
+	atomic_fetch_sub_explicit(&s->sleepers, 1, memory_order_relaxed);
+
+	return value;
+}
+
+static void sequence_publish(sequence* s)
+{
+	atomic_fetch_add_explicit(&s->value, 1, memory_order_release);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (atomic_load_explicit(&s->sleepers, memory_order_relaxed) > 0)
+	{
+		syscall(SYS_futex, &s->value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+const char* wait_strategy()
+{
+	return "spin then futex";
+}
+
+#endif
+
+void set_spin_budget(int spins)
+{
+	spin_budget = spins < 0 ? 0 : spins;
+}
+
+// one message in a ring. seq is one past the send that filled it, so the receiver can tell a message that has been
+// written from one that is still being written or one left over from the last time around the ring
+typedef struct slot
+{
+	_Atomic unsigned long long seq;
+	msg m;
+} slot;
+
+// boxes are laid out a cache line apart so threads working on neighbouring boxes do not slow each other down. building
+// with -DMAILBOX_ALIGN=8 packs them back to back instead, to measure what that is worth
+#ifndef MAILBOX_ALIGN
+#define MAILBOX_ALIGN 64
+#endif
+
+/*
+ * a bounded ring with many senders and one receiver. free_slots and full_slots count the room left and the messages
+ * waiting, so senders and the receiver only wait when the box is full or empty. a sender that gets past free_slots takes
+ * the next place in the ring with one atomic add, so senders never wait for each other.
+ * what the senders write and what the receiver writes are on separate cache lines. a box with room for one message keeps
+ * it in first_slot, next to what the sender already has to touch, and bigger rings come after the boxes in the same
+ * allocation
+*/
+typedef struct box
+{
+	// the receiver's side. where the next message is received from, only the receiver touches it
+	_Alignas(MAILBOX_ALIGN) counter full_slots;
+	unsigned long long head;
+
+	// the sequence number of the last broadcast the receiver took
+	unsigned broadcast_seen;
+
+	// the ring, and its size less one. it is a power of two so a position is wrapped with a mask
+	slot* slots;
+	unsigned long long mask;
+
+	// the senders' side. where the next message is sent to, shared by the senders
+	_Alignas(MAILBOX_ALIGN) _Atomic unsigned long long tail;
+	counter free_slots;
+	slot first_slot;
+} box;
+
+// every box one after the other, followed by the rings too big to fit in them
+box* boxes;
+
+/*
+ * one message for every receiver at once. the broadcaster writes it and publishes the next sequence number, and each
+ * receiver copies it and posts taken. the broadcaster takes all of those before it writes the next message, so no one
+ * misses one
+*/
+typedef struct broadcast
+{
+	_Alignas(MAILBOX_ALIGN) sequence seq;
+	msg m;
+
+	// how many receivers the last message went to, only the broadcaster touches it
+	int receivers;
+
+	_Alignas(MAILBOX_ALIGN) counter taken;
+} broadcast;
+
+// the one channel every broadcast goes through, whoever sends it, which is why there can only be one broadcaster at a time
+static broadcast channel;
+
+/*
+ * returns
+ * the size of a ring with room for capacity messages, a power of two
+*/
+static unsigned long long ring_size(int capacity)
+{
+	unsigned long long size = 1;
+	while (size < (unsigned long long) capacity)
+	{
+		size *= 2;
+	}
+
+	return size;
+}
+
+/*
+ * returns
+ * the bytes a ring with room for capacity messages takes, rounded up to whole lines
+*/
+static size_t ring_bytes(int capacity)
+{
+	return (ring_size(capacity) * sizeof(slot) + MAILBOX_ALIGN - 1) / MAILBOX_ALIGN * MAILBOX_ALIGN;
+}
+
+void init_boxes(int num_boxes, const int* capacities)
+{
+	// with one cpu, whoever is being waited for cannot run while someone spins
+	if (spin_budget < 0)
+	{
+		spin_budget = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DEFAULT_SPIN_BUDGET : 0;
+	}
+
+	// the rings go after the boxes, each starting on a line of its own
+	size_t total = sizeof(box) * num_boxes;
+	for (int i = 0; i < num_boxes; i++)
+	{
+		if (capacities != NULL && capacities[i] > 1)
+		{
+			total += ring_bytes(capacities[i]);
+		}
+	}
+
+	boxes = aligned_alloc(MAILBOX_ALIGN, total);
+	memset(boxes, 0, total);
+
+	char* rings = (char*) (boxes + num_boxes);
 	for (int i = 0; i < num_boxes; i++)
 	{
-		boxes[i] = malloc(sizeof(msg));
-		sems[i] = malloc(sizeof(sem_t) * 2);
-		if (sem_init(&sems[i][READY_FOR_WRITE], 0, 1) != 0)
+		int capacity = capacities != NULL && capacities[i] > 1 ? capacities[i] : 1;
+
+		if (capacity == 1)
 		{
-			printf("Could not init semaphore\n");
+			boxes[i].slots = &boxes[i].first_slot;
 		}
-		if (sem_init(&sems[i][READY_FOR_READ], 0, 0) != 0)
+		else
 		{
-			printf("Could not init semaphore\n");
+			boxes[i].slots = (slot*) rings;
+			rings += ring_bytes(capacity);
 		}
+		boxes[i].mask = ring_size(capacity) - 1;
+		atomic_init(&boxes[i].tail, 0);
+		boxes[i].head = 0;
+
+		// the ring can be bigger than the box, only capacity of it is ever used
+		counter_init(&boxes[i].free_slots, capacity);
+		counter_init(&boxes[i].full_slots, 0);
 	}
+
+	sequence_init(&channel.seq);
+	counter_init(&channel.taken, 0);
+	channel.receivers = 0;
 }
 
 void free_boxes(int num_boxes)
 {
 	for (int i = 0; i < num_boxes; i++)
 	{
-		sem_destroy(&sems[i][READY_FOR_WRITE]);
-		sem_destroy(&sems[i][READY_FOR_READ]);
-		free(sems[i]);
-		free(boxes[i]);
+		counter_destroy(&boxes[i].free_slots);
+		counter_destroy(&boxes[i].full_slots);
 	}
 
+	sequence_destroy(&channel.seq);
+	counter_destroy(&channel.taken);
+
 	free(boxes);
-	free(sems);
+}
+
+/*
+ * puts n messages in a box, one after the other, once the sender has taken n of its free slots
+*/
+static void put(box* b, msg* msgs, int n)
+{
+	// every message before the one capacity places back has been received, so these slots are free
+	unsigned long long pos = atomic_fetch_add_explicit(&b->tail, n, memory_order_relaxed);
+	for (int i = 0; i < n; i++)
+	{
+		slot* s = &b->slots[(pos + i) & b->mask];
+		s->m = msgs[i];
+		atomic_store_explicit(&s->seq, pos + i + 1, memory_order_release);
+	}
+
+	counter_post(&b->full_slots, n);
+}
+
+/*
+ * takes n messages out of a box once the receiver has taken n of its full slots
+*/
+static void take(box* b, msg* msgs, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		// a message is waiting, but it can be a later one than this. the sender that took this slot may not have finished
+		// writing it yet, which it is about to
+		slot* s = &b->slots[b->head & b->mask];
+		while (atomic_load_explicit(&s->seq, memory_order_acquire) != b->head + 1)
+		{
+			sched_yield();
+		}
+
+		msgs[i] = s->m;
+		b->head++;
+	}
+
+	counter_post(&b->free_slots, n);
 }
 
 void SendMsg(int iTo, msg* pMsg)
 {
-	sem_wait(&sems[iTo][READY_FOR_WRITE]);
-	boxes[iTo]->iSender = pMsg->iSender;
-	boxes[iTo]->type = pMsg->type;
-	boxes[iTo]->value1 = pMsg->value1;
-	boxes[iTo]->value2 = pMsg->value2;
-	sem_post(&sems[iTo][READY_FOR_READ]);
+	counter_timedwait(&boxes[iTo].free_slots, -1);
+	put(&boxes[iTo], pMsg, 1);
 }
 
 void RecvMsg(int iFrom, msg* pMsg)
 {
-	sem_wait(&sems[iFrom][READY_FOR_READ]);
-	pMsg->iSender = boxes[iFrom]->iSender;
-	pMsg->type = boxes[iFrom]->type;
-	pMsg->value1 = boxes[iFrom]->value1;
-	pMsg->value2 = boxes[iFrom]->value2;
-	sem_post(&sems[iFrom][READY_FOR_WRITE]);
+	counter_timedwait(&boxes[iFrom].full_slots, -1);
+	take(&boxes[iFrom], pMsg, 1);
+}
+
+int TrySendMsg(int iTo, msg* pMsg)
+{
+	if (counter_trytake(&boxes[iTo].free_slots, 1) == 0)
+	{
+		return MAILBOX_FULL;
+	}
+
+	put(&boxes[iTo], pMsg, 1);
+	return MAILBOX_OK;
+}
+
+int TryRecvMsg(int iFrom, msg* pMsg)
+{
+	if (counter_trytake(&boxes[iFrom].full_slots, 1) == 0)
+	{
+		return MAILBOX_EMPTY;
+	}
+
+	take(&boxes[iFrom], pMsg, 1);
+	return MAILBOX_OK;
+}
+
+int RecvMsgTimeout(int iFrom, msg* pMsg, long long timeout_us)
+{
+	if (timeout_us <= 0)
+	{
+		return TryRecvMsg(iFrom, pMsg) == MAILBOX_OK ? MAILBOX_OK : MAILBOX_TIMEOUT;
+	}
+
+	if (!counter_timedwait(&boxes[iFrom].full_slots, timeout_us))
+	{
+		return MAILBOX_TIMEOUT;
+	}
+
+	take(&boxes[iFrom], pMsg, 1);
+	return MAILBOX_OK;
+}
+
+void BroadcastMsg(msg* pMsg, int num_receivers)
+{
+	// the last message is only overwritten once every receiver has its copy
+	int left = channel.receivers;
+	while (left > 0)
+	{
+		int n = counter_trytake(&channel.taken, left);
+		if (n == 0)
+		{
+			counter_timedwait(&channel.taken, -1);
+			n = 1;
+		}
+		left -= n;
+	}
+
+	channel.m = *pMsg;
+	channel.receivers = num_receivers;
+	sequence_publish(&channel.seq);
+}
+
+void RecvBroadcast(int iFrom, msg* pMsg)
+{
+	box* b = &boxes[iFrom];
+
+	b->broadcast_seen = sequence_wait(&channel.seq, b->broadcast_seen);
+	*pMsg = channel.m;
+
+	counter_post(&channel.taken, 1);
+}
+
+void SendMsgBatch(int iTo, msg* msgs, int count)
+{
+	box* b = &boxes[iTo];
+
+	// as many as there is room for go in one go, waiting only when there is no room at all
+	int sent = 0;
+	while (sent < count)
+	{
+		int n = counter_trytake(&b->free_slots, count - sent);
+		if (n == 0)
+		{
+			counter_timedwait(&b->free_slots, -1);
+			n = 1 + counter_trytake(&b->free_slots, count - sent - 1);
+		}
+
+		put(b, msgs + sent, n);
+		sent += n;
+	}
+}
+
+int RecvMsgBatch(int iFrom, msg* buf, int max)
+{
+	if (max <= 0)
+	{
+		return 0;
+	}
+
+	box* b = &boxes[iFrom];
+
+	int n = counter_trytake(&b->full_slots, max);
+	if (n == 0)
+	{
+		counter_timedwait(&b->full_slots, -1);
+		n = 1 + counter_trytake(&b->full_slots, max - 1);
+	}
+
+	take(b, buf, n);
+	return n;
 }
@@ -1,6 +1,12 @@
 #ifndef MAILBOX_H
 #define MAILBOX_H
 
+// what TrySendMsg(), TryRecvMsg() and RecvMsgTimeout() return
+#define MAILBOX_OK 0
+#define MAILBOX_FULL 1
+#define MAILBOX_EMPTY 2
+#define MAILBOX_TIMEOUT 3
+
 typedef struct msg
 {
 	int iSender;
@@ -9,12 +15,110 @@ typedef struct msg
 	int value2;
 } msg;
 
-void init_boxes(int num_boxes);
+/*
+ * sets up the mailboxes. each box is a ring of messages that any number of threads can send to and one thread receives
+ * from, in the order they were sent. the boxes are one array with each box on cache lines of its own
+ * params
+ * num_boxes: the number of boxes, numbered from 0
+ * capacities: how many messages box i holds before senders block, capacities[i]. NULL gives every box room for one,
+ * where a sender waits until the receiver has taken the last message before it can send another
+ * returns void
+*/
+void init_boxes(int num_boxes, const int* capacities);
 
 void free_boxes(int num_boxes);
 
+/*
+ * sets how long a send or receive that has to wait spins before it sleeps: it checks its box again this many times with
+ * a pause in between, which is far quicker to wake from than sleeping when the thread it waits for is running on
+ * another cpu. the default is 1000, or 0 on a machine with one cpu
+ * params
+ * spins: the number of checks, 0 sleeps straight away
+ * returns void
+*/
+void set_spin_budget(int spins);
+
+/*
+ * returns
+ * how waiting threads wait, "spin then futex", or "semaphores" when built with -DMAILBOX_SEMAPHORES, where there is no
+ * spinning
+*/
+const char* wait_strategy();
+
+/*
+ * puts a message in a box, blocking while the box is full
+*/
 void SendMsg(int iTo, msg* pMsg);
 
+/*
+ * takes the oldest message out of a box, blocking while the box is empty
+*/
 void RecvMsg(int iFrom, msg* pMsg);
 
+/*
+ * SendMsg() that never blocks
+ * returns
+ * MAILBOX_OK if the message was sent, MAILBOX_FULL if the box had no room and nothing was sent
+*/
+int TrySendMsg(int iTo, msg* pMsg);
+
+/*
+ * RecvMsg() that never blocks
+ * returns
+ * MAILBOX_OK if a message was received, MAILBOX_EMPTY if the box had none and pMsg is left alone
+*/
+int TryRecvMsg(int iFrom, msg* pMsg);
+
+/*
+ * RecvMsg() that gives up after a while
+ * params
+ * iFrom: the box
+ * pMsg: set to the message
+ * timeout_us: how many microseconds to wait for one, 0 is the same as TryRecvMsg()
+ * returns
+ * MAILBOX_OK if a message was received, MAILBOX_TIMEOUT if none came in time and pMsg is left alone
+*/
+int RecvMsgTimeout(int iFrom, msg* pMsg, long long timeout_us);
+
+/*
+ * sends one message to num_receivers threads at once, each of which takes it with RecvBroadcast(). it is published under
+ * a new sequence number that all of them wait on, and whoever is asleep is woken together. blocks until every receiver
+ * of the last broadcast has taken it.
+ * there is a single broadcast channel, not one per box: only one thread may broadcast at a time, and every thread that
+ * calls RecvBroadcast() takes every broadcast, so the same threads have to receive each one
+ * params
+ * pMsg: the message, copied before this returns
+ * num_receivers: how many threads call RecvBroadcast() for it, every one of them has to or the next broadcast never goes
+ * out
+ * returns void
+*/
+void BroadcastMsg(msg* pMsg, int num_receivers);
+
+/*
+ * waits for the next broadcast and takes it, see BroadcastMsg(). broadcasts do not go through the boxes, so they are
+ * never mixed in with what is sent to them
+ * params
+ * iFrom: the receiver's own box, which keeps track of the last broadcast it took
+ * pMsg: set to the message
+ * returns void
+*/
+void RecvBroadcast(int iFrom, msg* pMsg);
+
+/*
+ * sends count messages to one box in order, as many at a time as there is room for, so a box with room for all of them
+ * takes them in one handoff. blocks while the box is full
+*/
+void SendMsgBatch(int iTo, msg* msgs, int count);
+
+/*
+ * takes every message waiting in a box, up to max, in one handoff, blocking until there is at least one
+ * params
+ * iFrom: the box
+ * buf: where the messages go, in the order they were sent
+ * max: how many buf has room for
+ * returns
+ * the number of messages received
+*/
+int RecvMsgBatch(int iFrom, msg* buf, int max);
+
 #endif
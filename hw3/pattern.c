@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pattern.h"
+
+#define FORMAT_TEXT 0
+#define FORMAT_CELLS 1
+#define FORMAT_RLE 2
+
+/*
+ * each parser walks the file between p and end. with g NULL it only works out the size of the board into rows and cols,
+ * otherwise it sets the live cells of g, which has already been made that size
+ * returns
+ * 0 on success, -1 after printing what went wrong
+*/
+static int parse_text(const char* p, const char* end, grid* g, int* rows, int* cols);
+static int parse_cells(const char* p, const char* end, grid* g, int* rows, int* cols);
+static int parse_rle(const char* p, const char* end, grid* g, int* rows, int* cols);
+
+static int guess_format(const char* filename, const char* p, const char* end);
+
+// RLE files keep their lines at most this long, as the format asks
+#define RLE_LINE_LENGTH 70
+
+// a buffer that grows as it is appended to
+typedef struct text
+{
+	char* data;
+	size_t len;
+	size_t cap;
+} text;
+
+int load_pattern(const char* filename, grid* g)
+{
+	int fd = open(filename, O_RDONLY);
+
+	if (fd == -1)
+	{
+		printf("Could not open file.\n");
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0)
+	{
+		printf("Could not read file, or it is empty.\n");
+		close(fd);
+		return -1;
+	}
+
+	char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		printf("Could not map file.\n");
+		return -1;
+	}
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	const char* end = data + st.st_size;
+
+	int (*parse)(const char*, const char*, grid*, int*, int*);
+	switch (guess_format(filename, data, end))
+	{
+		case FORMAT_CELLS:
+			parse = parse_cells;
+			break;
+		case FORMAT_RLE:
+			parse = parse_rle;
+			break;
+		default:
+			parse = parse_text;
+			break;
+	}
+
+	int rows = 0;
+	int cols = 0;
+	int ret = parse(data, end, NULL, &rows, &cols);
+
+	if (ret == 0 && (rows == 0 || cols == 0))
+	{
+		printf("The file does not contain a board.\n");
+		ret = -1;
+	}
+
+	if (ret == 0 && init_grid(g, rows, cols) != 0)
+	{
+		printf("Could not allocate the grid.\n");
+		ret = -1;
+	}
+
+	if (ret == 0)
+	{
+		ret = parse(data, end, g, &rows, &cols);
+		if (ret != 0)
+		{
+			free_grid(g);
+		}
+	}
+
+	munmap(data, st.st_size);
+
+	return ret;
+}
+
+static int guess_format(const char* filename, const char* p, const char* end)
+{
+	const char* ext = strrchr(filename, '.');
+
+	if (ext != NULL && !strcmp(ext, ".cells"))
+	{
+		return FORMAT_CELLS;
+	}
+	else if (ext != NULL && !strcmp(ext, ".rle"))
+	{
+		return FORMAT_RLE;
+	}
+
+	while (p < end && isspace((unsigned char) *p))
+	{
+		p++;
+	}
+
+	if (p < end && (*p == '#' || *p == 'x'))
+	{
+		return FORMAT_RLE;
+	}
+	else if (p < end && (*p == '!' || *p == '.' || *p == 'O'))
+	{
+		return FORMAT_CELLS;
+	}
+
+	return FORMAT_TEXT;
+}
+
+static int parse_text(const char* p, const char* end, grid* g, int* rows, int* cols)
+{
+	int row = 0;
+
+	while (p < end)
+	{
+		const char* eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+		{
+			eol = end;
+		}
+
+		int col = 0;
+		for (; p < eol; p++)
+		{
+			if (*p == '1' || *p == '0')
+			{
+				if (g != NULL && *p == '1')
+				{
+					set_cell(g, row, col, true);
+				}
+				col++;
+			}
+		}
+
+		// lines without any cells, like a trailing blank line, are not rows
+		if (col > 0)
+		{
+			if (col > *cols)
+			{
+				*cols = col;
+			}
+			row++;
+		}
+
+		p = eol + 1;
+	}
+
+	*rows = row;
+
+	return 0;
+}
+
+static int parse_cells(const char* p, const char* end, grid* g, int* rows, int* cols)
+{
+	int row = 0;
+	int last_row = 0;
+
+	while (p < end)
+	{
+		const char* eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+		{
+			eol = end;
+		}
+
+		if (*p != '!')
+		{
+			int col = 0;
+			for (; p < eol; p++)
+			{
+				if (*p == 'O' || *p == '*')
+				{
+					if (g != NULL)
+					{
+						set_cell(g, row, col, true);
+					}
+					col++;
+				}
+				else if (*p == '.')
+				{
+					col++;
+				}
+			}
+
+			// unlike the 0/1 format, an empty line is a row of dead cells, unless it comes after the last row
+			if (col > *cols)
+			{
+				*cols = col;
+			}
+			row++;
+			if (col > 0)
+			{
+				last_row = row;
+			}
+		}
+
+		p = eol + 1;
+	}
+
+	*rows = last_row;
+
+	return 0;
+}
+
+static int parse_rle(const char* p, const char* end, grid* g, int* rows, int* cols)
+{
+	// comments, then the header
+	while (p < end && (*p == '#' || isspace((unsigned char) *p)))
+	{
+		if (*p == '#')
+		{
+			const char* eol = memchr(p, '\n', end - p);
+			p = eol == NULL ? end : eol;
+		}
+		p++;
+	}
+
+	const char* eol = memchr(p, '\n', end - p);
+	if (eol == NULL)
+	{
+		eol = end;
+	}
+
+	char header[256];
+	size_t len = eol - p < (long) sizeof(header) - 1 ? (size_t) (eol - p) : sizeof(header) - 1;
+	memcpy(header, p, len);
+	header[len] = '\0';
+
+	int x;
+	int y;
+	if (sscanf(header, " x = %d , y = %d", &x, &y) != 2 || x <= 0 || y <= 0)
+	{
+		printf("RLE file is missing its \"x = <cols>, y = <rows>\" header.\n");
+		return -1;
+	}
+
+	*rows = y;
+	*cols = x;
+
+	if (g == NULL)
+	{
+		return 0;
+	}
+
+	int row = 0;
+	int col = 0;
+	long count = 0;
+
+	for (p = eol; p < end && *p != '!'; p++)
+	{
+		char c = *p;
+
+		if (isdigit((unsigned char) c))
+		{
+			// no run is longer than the board, which also keeps count from overflowing
+			count = count * 10 + (c - '0');
+			if (count > x && count > y)
+			{
+				printf("RLE run of more than %d cells does not fit in its %d by %d header.\n", x > y ? x : y, x, y);
+				return -1;
+			}
+			continue;
+		}
+		else if (isspace((unsigned char) c))
+		{
+			continue;
+		}
+
+		if (count == 0)
+		{
+			count = 1;
+		}
+
+		// past the bottom or the right edge is as far as row and col need to go, any live cell there is rejected below
+		if (c == '$')
+		{
+			row = row + count > y ? y : row + count;
+			col = 0;
+		}
+		else if (c == 'b')
+		{
+			col = col + count > x ? x : col + count;
+		}
+		else if (isalpha((unsigned char) c))
+		{
+			// every other letter is some kind of live cell
+			if (row < 0 || col < 0 || row >= y || col + count > x)
+			{
+				printf("RLE pattern does not fit in its %d by %d header.\n", x, y);
+				return -1;
+			}
+
+			for (long i = 0; i < count; i++)
+			{
+				set_cell(g, row, col++, true);
+			}
+		}
+
+		count = 0;
+	}
+
+	return 0;
+}
+
+static void append(text* t, const char* s, size_t len)
+{
+	if (t->len + len > t->cap)
+	{
+		size_t cap = t->cap * 2 > t->len + len ? t->cap * 2 : t->len + len;
+		char* grown = realloc(t->data, cap);
+		if (grown == NULL)
+		{
+			return;
+		}
+		t->data = grown;
+		t->cap = cap;
+	}
+
+	memcpy(t->data + t->len, s, len);
+	t->len += len;
+}
+
+/*
+ * adds one run to an RLE body, breaking the line first if the run would make it too long
+*/
+static void append_run(text* t, int* line_len, int count, char tag)
+{
+	char run[16];
+	int len = count > 1 ? sprintf(run, "%d%c", count, tag) : sprintf(run, "%c", tag);
+
+	if (*line_len + len > RLE_LINE_LENGTH)
+	{
+		append(t, "\n", 1);
+		*line_len = 0;
+	}
+
+	append(t, run, len);
+	*line_len += len;
+}
+
+/*
+ * returns
+ * the first column at or after col whose cell is not alive, or cols if they all are
+*/
+static int run_end(grid* g, uint64_t* row, int col, bool alive)
+{
+	int w = col / CELLS_PER_WORD;
+	uint64_t flip = alive ? ~(uint64_t) 0 : 0;
+	uint64_t bits = (row[w] ^ flip) & (~(uint64_t) 0 << (col % CELLS_PER_WORD));
+
+	while (bits == 0)
+	{
+		if (++w >= g->words)
+		{
+			return g->cols;
+		}
+		bits = row[w] ^ flip;
+	}
+
+	int end = w * CELLS_PER_WORD + __builtin_ctzll(bits);
+	return end < g->cols ? end : g->cols;
+}
+
+static int write_all(int fd, const char* data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n <= 0)
+		{
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int save_pattern(const char* filename, grid* g, const char* comment, const char* rule_name)
+{
+	text t = {NULL, 0, 0};
+	char header[256];
+	append(&t, header, snprintf(header, sizeof(header), "#C %s\nx = %d, y = %d, rule = %s\n", comment, g->cols, g->rows,
+		rule_name));
+
+	int line_len = 0;
+
+	// rows end with $, and runs of rows with nothing alive in them are folded into the next one that has something
+	int pending_rows = 0;
+
+	for (int i = 0; i < g->rows; i++)
+	{
+		uint64_t* row = grid_row(g, i);
+		int col = 0;
+
+		while (col < g->cols)
+		{
+			int dead_end = run_end(g, row, col, false);
+			if (dead_end == g->cols)
+			{
+				break;
+			}
+
+			if (pending_rows > 0)
+			{
+				append_run(&t, &line_len, pending_rows, '$');
+				pending_rows = 0;
+			}
+			if (dead_end > col)
+			{
+				append_run(&t, &line_len, dead_end - col, 'b');
+			}
+
+			col = run_end(g, row, dead_end, true);
+			append_run(&t, &line_len, col - dead_end, 'o');
+		}
+
+		pending_rows++;
+	}
+	append(&t, "!\n", 2);
+
+	int ret = 0;
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1 || t.data == NULL || write_all(fd, t.data, t.len) != 0)
+	{
+		printf("Could not write %s.\n", filename);
+		ret = -1;
+	}
+
+	if (fd != -1)
+	{
+		close(fd);
+	}
+	free(t.data);
+
+	return ret;
+}
@@ -0,0 +1,34 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "grid.h"
+
+/*
+ * loads a starting board from a file. the file is mmapped and read twice, once to find the board's size and once to set
+ * its cells, so nothing the size of the file is copied. three formats are understood:
+ * - the 0/1 text life has always read, one row per line with the cells as 0s and 1s
+ * - plaintext (.cells), one row per line with . for dead and O for alive, lines starting with ! are comments
+ * - run length encoded (.rle), a header line "x = <cols>, y = <rows>" followed by runs of b (dead) and o (alive) with $
+ *   ending a row and ! ending the pattern, lines starting with # are comments
+ * the format is taken from the file's extension, or guessed from its first character when the extension is neither
+ * params
+ * filename: the file to load
+ * g: set up with init_grid() to the board's size and filled in
+ * returns
+ * 0 on success, -1 after printing what went wrong
+*/
+int load_pattern(const char* filename, grid* g);
+
+/*
+ * saves a board as run length encoded, in the form load_pattern() reads back
+ * params
+ * filename: the file to write, replaced if it is there
+ * g: the board
+ * comment: put on a #C line at the top
+ * rule_name: the rulestring in the header
+ * returns
+ * 0 on success, -1 after printing what went wrong
+*/
+int save_pattern(const char* filename, grid* g, const char* comment, const char* rule_name);
+
+#endif
@@ -0,0 +1,247 @@
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "rule.h"
+
+// the counts a cell can have, 0 to 8
+#define MAX_NEIGHBOURS 8
+
+typedef struct known_rule
+{
+	const char* name;
+	uint16_t birth;
+	uint16_t survive;
+	step_func kernel;
+} known_rule;
+
+// the rule the runtime kernel runs
+static rule runtime_rule;
+
+// bitwise s ? b : a
+static inline __attribute__((always_inline)) uint64_t choose(uint64_t s, uint64_t a, uint64_t b)
+{
+	return (a & ~s) | (b & s);
+}
+
+/*
+ * the next state of cells with n neighbours: all of them if the rule says so whether they are alive or not, none of them,
+ * or just the ones that are alive or dead now
+*/
+static inline __attribute__((always_inline)) uint64_t rule_leaf(uint64_t c, uint16_t birth, uint16_t survive, int n)
+{
+	return choose(c, (birth >> n) & 1 ? ~(uint64_t) 0 : 0, (survive >> n) & 1 ? ~(uint64_t) 0 : 0);
+}
+
+/*
+ * computes 64 cells of the next generation under a rule. the count's bits pick the cells' fate out of a tree of bitwise
+ * selects whose leaves come straight from the rule. always inlined, so where birth and survive are constants every leaf
+ * is 0, all ones, c or ~c and the tree folds down at compile time: for B3/S23 it is exactly twos & ~fours & (ones | c),
+ * the hand-written test. this is the template the specialized kernels are stamped out from
+ * returns
+ * the cells' next generation
+*/
+static inline __attribute__((always_inline)) uint64_t rule_cells(uint64_t a_west, uint64_t a, uint64_t a_east,
+	uint64_t c_west, uint64_t c, uint64_t c_east, uint64_t b_west, uint64_t b, uint64_t b_east, uint16_t birth,
+	uint16_t survive)
+{
+	// the same adder tree as next_cells, with the count carried into a fourth bit since 0 and 8 can mean different things
+	uint64_t sum_a, carry_a;
+	uint64_t sum_b, carry_b;
+	full_add(a_west, a, a_east, &sum_a, &carry_a);
+	full_add(c_west, c_east, b_west, &sum_b, &carry_b);
+	uint64_t sum_c = b ^ b_east;
+	uint64_t carry_c = b & b_east;
+
+	uint64_t ones, carry_ones;
+	full_add(sum_a, sum_b, sum_c, &ones, &carry_ones);
+
+	uint64_t twos_low, twos_high;
+	full_add(carry_a, carry_b, carry_c, &twos_low, &twos_high);
+	uint64_t twos = twos_low ^ carry_ones;
+	uint64_t fours = twos_high ^ (twos_low & carry_ones);
+
+	// a count of 8 has its low three bits clear, so it shares a leaf with 0
+	uint64_t zero_or_eight = rule_leaf(c, birth, survive, 0);
+	if ((((birth ^ (birth >> MAX_NEIGHBOURS)) | (survive ^ (survive >> MAX_NEIGHBOURS))) & 1) != 0)
+	{
+		uint64_t eights = twos_high & twos_low & carry_ones;
+		zero_or_eight = choose(eights, zero_or_eight, rule_leaf(c, birth, survive, MAX_NEIGHBOURS));
+	}
+
+	uint64_t zero_to_three = choose(twos, choose(ones, zero_or_eight, rule_leaf(c, birth, survive, 1)),
+		choose(ones, rule_leaf(c, birth, survive, 2), rule_leaf(c, birth, survive, 3)));
+	uint64_t four_to_seven = choose(twos, choose(ones, rule_leaf(c, birth, survive, 4), rule_leaf(c, birth, survive, 5)),
+		choose(ones, rule_leaf(c, birth, survive, 6), rule_leaf(c, birth, survive, 7)));
+
+	return choose(fours, zero_to_three, four_to_seven);
+}
+
+static inline __attribute__((always_inline)) uint64_t rule_word(uint64_t* above, uint64_t* row, uint64_t* below, int w,
+	uint16_t birth, uint16_t survive)
+{
+	uint64_t a = above[w];
+	uint64_t c = row[w];
+	uint64_t b = below[w];
+
+	return rule_cells((a << 1) | (above[w - 1] >> 63), a, (a >> 1) | (above[w + 1] << 63), (c << 1) | (row[w - 1] >> 63), c,
+		(c >> 1) | (row[w + 1] << 63), (b << 1) | (below[w - 1] >> 63), b, (b >> 1) | (below[w + 1] << 63), birth, survive);
+}
+
+/*
+ * step_packed for any rule, laid out the same way
+*/
+static inline __attribute__((always_inline)) void step_rule(grid* prev, grid* next, int start_row, int end_row,
+	int start_word, int end_word, bool* same_as_last, bool* all_dead, uint16_t birth, uint16_t survive)
+{
+	uint64_t alive = 0;
+	uint64_t changed = 0;
+
+	int last = prev->words - 1;
+	bool has_last = end_word > last;
+	int full_end = has_last ? last : end_word;
+
+	for (int i = start_row; i < end_row; i++)
+	{
+		uint64_t* above = grid_row(prev, i - 1);
+		uint64_t* row = grid_row(prev, i);
+		uint64_t* below = grid_row(prev, i + 1);
+		uint64_t* out = grid_row(next, i);
+
+		for (int w = start_word; w < full_end; w++)
+		{
+			uint64_t n = rule_word(above, row, below, w, birth, survive);
+			out[w] = n;
+			alive |= n;
+			changed |= n ^ row[w];
+		}
+
+		if (has_last)
+		{
+			uint64_t n = rule_word(above, row, below, last, birth, survive) & prev->last_mask;
+			out[last] = n;
+			alive |= n;
+			changed |= (n ^ row[last]) & prev->last_mask;
+		}
+	}
+
+	*same_as_last = changed == 0;
+	*all_dead = alive == 0;
+}
+
+// stamps out a kernel for one rule, the C stand-in for instantiating a template
+#define RULE_KERNEL(name, birth, survive) \
+	static void step_##name(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word, \
+		bool* same_as_last, bool* all_dead) \
+	{ \
+		step_rule(prev, next, start_row, end_row, start_word, end_word, same_as_last, all_dead, birth, survive); \
+	}
+
+RULE_KERNEL(highlife, 1 << 3 | 1 << 6, 1 << 2 | 1 << 3)
+RULE_KERNEL(seeds, 1 << 2, 0)
+RULE_KERNEL(daynight, 1 << 3 | 1 << 6 | 1 << 7 | 1 << 8, 1 << 3 | 1 << 4 | 1 << 6 | 1 << 7 | 1 << 8)
+
+static void step_runtime(grid* prev, grid* next, int start_row, int end_row, int start_word, int end_word,
+	bool* same_as_last, bool* all_dead)
+{
+	step_rule(prev, next, start_row, end_row, start_word, end_word, same_as_last, all_dead, runtime_rule.birth,
+		runtime_rule.survive);
+}
+
+static const known_rule known_rules[] =
+{
+	{"life", 1 << 3, 1 << 2 | 1 << 3, step_packed},
+	{"highlife", 1 << 3 | 1 << 6, 1 << 2 | 1 << 3, step_highlife},
+	{"seeds", 1 << 2, 0, step_seeds},
+	{"daynight", 1 << 3 | 1 << 6 | 1 << 7 | 1 << 8, 1 << 3 | 1 << 4 | 1 << 6 | 1 << 7 | 1 << 8, step_daynight},
+};
+
+#define NUM_KNOWN_RULES ((int) (sizeof(known_rules) / sizeof(known_rules[0])))
+
+int parse_rule(const char* s, rule* r)
+{
+	for (int i = 0; i < NUM_KNOWN_RULES; i++)
+	{
+		if (!strcasecmp(s, known_rules[i].name))
+		{
+			r->birth = known_rules[i].birth;
+			r->survive = known_rules[i].survive;
+			return 0;
+		}
+	}
+
+	r->birth = 0;
+	r->survive = 0;
+
+	uint16_t* counts = NULL;
+	bool seen_birth = false;
+	bool seen_survive = false;
+
+	for (; *s != '\0'; s++)
+	{
+		char c = toupper((unsigned char) *s);
+
+		if (c == 'B' && !seen_birth)
+		{
+			counts = &r->birth;
+			seen_birth = true;
+		}
+		else if (c == 'S' && !seen_survive)
+		{
+			counts = &r->survive;
+			seen_survive = true;
+		}
+		else if (c >= '0' && c <= '0' + MAX_NEIGHBOURS && counts != NULL)
+		{
+			*counts |= 1 << (c - '0');
+		}
+		else if (c != '/')
+		{
+			return -1;
+		}
+	}
+
+	return seen_birth && seen_survive ? 0 : -1;
+}
+
+void format_rule(rule* r, char* buf)
+{
+	*buf++ = 'B';
+	for (int n = 0; n <= MAX_NEIGHBOURS; n++)
+	{
+		if ((r->birth >> n) & 1)
+		{
+			*buf++ = '0' + n;
+		}
+	}
+
+	*buf++ = '/';
+	*buf++ = 'S';
+	for (int n = 0; n <= MAX_NEIGHBOURS; n++)
+	{
+		if ((r->survive >> n) & 1)
+		{
+			*buf++ = '0' + n;
+		}
+	}
+
+	*buf = '\0';
+}
+
+step_func specialized_kernel(rule* r)
+{
+	for (int i = 0; i < NUM_KNOWN_RULES; i++)
+	{
+		if (known_rules[i].birth == r->birth && known_rules[i].survive == r->survive)
+		{
+			return known_rules[i].kernel;
+		}
+	}
+
+	return NULL;
+}
+
+step_func runtime_kernel(rule* r)
+{
+	runtime_rule = *r;
+	return step_runtime;
+}
@@ -0,0 +1,62 @@
+#ifndef RULE_H
+#define RULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "grid.h"
+
+/*
+ * a Life-like rule, written as a rulestring like B3/S23: a dead cell with a number of live neighbours listed after the B
+ * comes alive, a live cell with a number listed after the S stays alive, and every other cell dies
+*/
+typedef struct rule
+{
+	// bit n is set if a dead cell with n live neighbours is born
+	uint16_t birth;
+
+	// bit n is set if a live cell with n live neighbours survives
+	uint16_t survive;
+} rule;
+
+/*
+ * reads a rulestring, "B<digits>/S<digits>" in either order and any case, or the name of one of the rules with their
+ * own kernel: life, highlife, seeds or daynight
+ * params
+ * s: the rulestring
+ * r: set to the rule
+ * returns
+ * 0 on success, -1 if s is not a rule
+*/
+int parse_rule(const char* s, rule* r);
+
+/*
+ * writes a rule out as a B/S rulestring
+ * params
+ * r: the rule
+ * buf: at least 24 characters
+ * returns void
+*/
+void format_rule(rule* r, char* buf);
+
+/*
+ * looks up the kernel compiled for one rule. the neighbour counts are added up by the same tree of full adders as
+ * step_packed, and since the rule is a constant the compiler reduces the test of the count to a handful of instructions,
+ * the same as the hand-written Conway test. B3/S23 is step_packed itself
+ * params
+ * r: the rule
+ * returns
+ * the rule's kernel, or NULL if it does not have one
+*/
+step_func specialized_kernel(rule* r);
+
+/*
+ * gets the kernel that runs any rule, testing each count the rule lists in turn. it is slower than a specialized kernel
+ * but needs nothing compiled in ahead of time
+ * params
+ * r: the rule, copied. the runtime kernel runs one rule at a time, so this replaces the one it ran before
+ * returns
+ * the runtime kernel
+*/
+step_func runtime_kernel(rule* r);
+
+#endif
@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+# usage: ./scaling.sh <board file> [num_generations] [tile]
+# runs life on one board with a growing number of threads, from 1 up to twice the number of cores or 16, whichever is
+# more, and prints how the simulation time scales. tile is passed to -t, leave it out to split the board into bands
+
+if [[ $# -lt 1 || $# -gt 3 ]]; then
+    echo "Usage: $0 <board file> [num_generations] [tile]" >&2
+    exit 1
+fi
+
+board=$1
+generations=${2:-100}
+tile=${3:+-t $3}
+life=${LIFE:-./life}
+# always measured past the old limit of 10 threads, even on small machines
+max_threads=$(($(nproc) * 2 > 16 ? $(nproc) * 2 : 16))
+
+if [[ ! -x $life ]]; then
+    echo "Could not find $life, build it with make first" >&2
+    exit 1
+fi
+
+printf "%-8s %-14s %-9s %-11s %s\n" Threads "Simulation ms" Speedup Efficiency "Sync us/gen"
+
+base=
+for ((threads = 1; threads <= max_threads; threads *= 2)); do
+    # -q leaves out the final board, so only the stats come out
+    stats=$("$life" -q -s -m barrier $tile "$threads" "$board" "$generations" n | sed -n '/^-->Run Stats<--$/,$p')
+    ms=$(awk -F': |ms' '/^Simulation Time/ {print $2}' <<< "$stats")
+    sync=$(awk -F': |us' '/^Sync Overhead/ {print $2}' <<< "$stats")
+    base=${base:-$ms}
+
+    awk -v t="$threads" -v ms="$ms" -v base="$base" -v sync="$sync" \
+        'BEGIN { printf "%-8d %-14.1f %-9.2f %-11.2f %.1f\n", t, ms, base / ms, base / ms / t, sync }'
+done
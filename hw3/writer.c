@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "writer.h"
+#include "pattern.h"
+
+// the writer's own flag, the frame after which it stops
+#define FRAME_STOP 16
+
+#define NUM_SLOTS 2
+
+static pthread_t thread;
+
+// the snapshot buffers, filled by submit_frame() in order and written by the writer in the same order
+static grid slots[NUM_SLOTS];
+static long long slot_gens[NUM_SLOTS];
+static int slot_flags[NUM_SLOTS];
+static checkpoint slot_checkpoints[NUM_SLOTS];
+static int next_submit;
+static int next_write;
+
+// counts the slots free to fill and the slots waiting to be written
+static sem_t free_slots;
+static sem_t full_slots;
+
+static const char* rule_text;
+static const char* file_prefix;
+
+// cell_text[b] is byte b of a row printed as 8 cells, "0 " or "1 " each
+static char cell_text[256][16];
+
+// where frames are rendered, big enough for the largest frame so printing never allocates
+static char* frame;
+
+static void* writer_func(void* arg);
+
+/*
+ * renders a board the way print_gen() always has and writes it to stdout in one go
+*/
+static void print_frame(grid* g, long long gen, bool last);
+
+/*
+ * saves a board as <prefix>-<gen>.rle
+*/
+static void save_frame(grid* g, long long gen);
+
+static void write_all(int fd, const char* data, size_t len);
+
+int start_writer(int rows, int cols, const char* rule_name, const char* prefix)
+{
+	rule_text = rule_name;
+	file_prefix = prefix;
+
+	for (int b = 0; b < 256; b++)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			cell_text[b][i * 2] = (b >> i) & 1 ? '1' : '0';
+			cell_text[b][i * 2 + 1] = ' ';
+		}
+	}
+
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (init_grid(&slots[i], rows, cols) != 0)
+		{
+			return -1;
+		}
+	}
+
+	// the header, then every row as its cells and a newline. rows are rendered a whole word at a time, so the last one can
+	// run past its end by up to a word's worth of cells before it is cut back
+	frame = malloc(64 + (size_t) rows * (cols * 2 + 1) + CELLS_PER_WORD * 2 + 2);
+	if (frame == NULL)
+	{
+		return -1;
+	}
+
+	sem_init(&free_slots, 0, NUM_SLOTS);
+	sem_init(&full_slots, 0, 0);
+
+	return pthread_create(&thread, NULL, writer_func, NULL) == 0 ? 0 : -1;
+}
+
+/*
+ * fills the next free slot, c is only read for checkpoints
+*/
+static void submit(grid* g, long long gen, int flags, checkpoint* c)
+{
+	sem_wait(&free_slots);
+
+	int slot = next_submit++ % NUM_SLOTS;
+	if (g != NULL)
+	{
+		memcpy(slots[slot].cells, g->cells, (size_t) (g->rows + 2) * g->stride * sizeof(uint64_t));
+	}
+	if (c != NULL)
+	{
+		slot_checkpoints[slot] = *c;
+	}
+	slot_gens[slot] = gen;
+	slot_flags[slot] = flags;
+
+	sem_post(&full_slots);
+}
+
+void submit_frame(grid* g, long long gen, int flags)
+{
+	submit(g, gen, flags, NULL);
+}
+
+void submit_checkpoint(grid* g, checkpoint* c)
+{
+	submit(g, c->generation, FRAME_CHECKPOINT, c);
+}
+
+void flush_writer()
+{
+	// once every slot is free again, everything handed over has been written
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		sem_wait(&free_slots);
+	}
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		sem_post(&free_slots);
+	}
+}
+
+void stop_writer()
+{
+	submit(NULL, 0, FRAME_STOP, NULL);
+	pthread_join(thread, NULL);
+
+	sem_destroy(&free_slots);
+	sem_destroy(&full_slots);
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		free_grid(&slots[i]);
+	}
+	free(frame);
+}
+
+static void* writer_func(void* arg)
+{
+	(void) arg;
+
+	while (true)
+	{
+		sem_wait(&full_slots);
+
+		int slot = next_write++ % NUM_SLOTS;
+		int flags = slot_flags[slot];
+
+		if (flags & FRAME_STOP)
+		{
+			break;
+		}
+
+		if (flags & (FRAME_PRINT | FRAME_LAST))
+		{
+			print_frame(&slots[slot], slot_gens[slot], flags & FRAME_LAST);
+		}
+		if (flags & FRAME_SAVE)
+		{
+			save_frame(&slots[slot], slot_gens[slot]);
+		}
+		if (flags & FRAME_CHECKPOINT)
+		{
+			char path[4096];
+			snprintf(path, sizeof(path), "%s.ckpt", file_prefix);
+			save_checkpoint(path, &slots[slot], &slot_checkpoints[slot]);
+		}
+
+		sem_post(&free_slots);
+	}
+
+	return NULL;
+}
+
+static void print_frame(grid* g, long long gen, bool last)
+{
+	char* p = frame;
+
+	if (last)
+	{
+		p += sprintf(p, "The game ends after %lld generations with:\n", gen);
+	}
+	else
+	{
+		p += sprintf(p, "Generation %lld:\n", gen);
+	}
+
+	for (int i = 0; i < g->rows; i++)
+	{
+		uint64_t* row = grid_row(g, i);
+		char* start = p;
+
+		for (int w = 0; w < g->words; w++)
+		{
+			for (int b = 0; b < 8; b++)
+			{
+				memcpy(p, cell_text[(row[w] >> (b * 8)) & 0xFF], 16);
+				p += 16;
+			}
+		}
+
+		p = start + g->cols * 2;
+		*p++ = '\n';
+	}
+
+	if (!last)
+	{
+		*p++ = '\n';
+	}
+
+	// anything printed before this frame was handed over has to come out first
+	fflush(stdout);
+	write_all(STDOUT_FILENO, frame, p - frame);
+}
+
+static void save_frame(grid* g, long long gen)
+{
+	char filename[4096];
+	char comment[64];
+	snprintf(filename, sizeof(filename), "%s-%lld.rle", file_prefix, gen);
+	snprintf(comment, sizeof(comment), "generation %lld", gen);
+
+	save_pattern(filename, g, comment, rule_text);
+}
+
+static void write_all(int fd, const char* data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n <= 0)
+		{
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
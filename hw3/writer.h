@@ -0,0 +1,58 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "grid.h"
+#include "checkpoint.h"
+
+// what to do with a frame, more than one can be set
+#define FRAME_PRINT 1
+#define FRAME_LAST 2
+#define FRAME_SAVE 4
+#define FRAME_CHECKPOINT 8
+
+/*
+ * starts the thread that turns boards into output. boards are handed to it as frames, copied into one of two snapshot
+ * buffers, so the caller can go straight back to computing while the last frame is still being written. a frame is
+ * printed by rendering the whole board into one buffer and handing it to a single write(), and saved as an RLE file
+ * named <prefix>-<generation>.rle that load_pattern() can read back. checkpoints are written the same way, to <prefix>.ckpt
+ * params
+ * rows: the number of rows of every board
+ * cols: the number of columns of every board
+ * rule_name: the rulestring written into saved files
+ * prefix: where saved files and checkpoints go
+ * returns
+ * 0 on success, -1 if the buffers or the thread could not be set up
+*/
+int start_writer(int rows, int cols, const char* rule_name, const char* prefix);
+
+/*
+ * hands a board to the writer. only blocks when both snapshot buffers are still waiting to be written
+ * params
+ * g: the board, which can be changed as soon as this returns
+ * gen: its generation
+ * flags: FRAME_PRINT prints it as "Generation <gen>:", FRAME_LAST prints it as the board the game ended with, FRAME_SAVE
+ * saves it to a file
+ * returns void
+*/
+void submit_frame(grid* g, long long gen, int flags);
+
+/*
+ * hands a board to the writer to be checkpointed, blocking the same way submit_frame() does
+ * params
+ * g: the board, which can be changed as soon as this returns
+ * c: the rest of the state to save with it, copied
+ * returns void
+*/
+void submit_checkpoint(grid* g, checkpoint* c);
+
+/*
+ * waits until every frame handed to the writer has been written, so what is printed next comes after them
+*/
+void flush_writer();
+
+/*
+ * writes any frames still waiting and stops the writer
+*/
+void stop_writer();
+
+#endif